@@ -0,0 +1,69 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <chrono>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+
+// Outcome of a call of Controller::Solve.
+struct MPC_result {
+  enum Status {
+    // the solver converged, or the real-time iteration took its step
+    CONVERGED,
+    // stopped at the deadline, the plan is the best feasible iterate
+    TRUNCATED,
+    // no usable solution
+    FAILED
+  };
+  Status status;
+  // number of solver iterations
+  int iterations;
+  // first actuations, the steering angle and the acceleration
+  double delta;
+  double a;
+  // x and y of the predicted trajectory in the vehicle frame, one per stage;
+  // empty when the solve failed
+  std::vector<double> x;
+  std::vector<double> y;
+  // wall-clock time of the solve in milliseconds
+  double solve_ms;
+
+  MPC_result()
+      : status(FAILED), iterations(0), delta(0.0), a(0.0), solve_ms(0.0) {}
+};
+
+// A controller driven once per tick by main.cpp and mpc_bench, whatever
+// solves the problem behind it. The backends are selected by name, see
+// MPC_registry.
+class Controller {
+ public:
+  virtual ~Controller() {}
+
+  // Global pose of the vehicle frame that the next state and coefficients
+  // are expressed in, for controllers that carry their plan over.
+  virtual void SetFrame(double px, double py, double psi) {}
+
+  // Solve for an initial state (x, y, psi, v, cte, epsi) in the vehicle
+  // frame and the polynomial coefficients of the path, stopped at the
+  // wall-clock `deadline`. The time it took goes into the result.
+  MPC_result Solve(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                   std::chrono::steady_clock::time_point deadline) {
+    auto start = std::chrono::steady_clock::now();
+    MPC_result result = Plan(state, coeffs, deadline);
+    result.solve_ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start).count();
+    return result;
+  }
+
+  // Work done after the actuation is sent, while waiting for the next
+  // telemetry with the coefficients of this tick.
+  virtual void Prepare(const Eigen::VectorXd& coeffs) {}
+
+ protected:
+  // The solve behind Solve.
+  virtual MPC_result Plan(const Eigen::VectorXd& state,
+                          const Eigen::VectorXd& coeffs,
+                          std::chrono::steady_clock::time_point deadline) = 0;
+};
+
+#endif /* CONTROLLER_H */
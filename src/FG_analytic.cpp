@@ -0,0 +1,303 @@
+#include "FG_analytic.h"
+#include <math.h>
+#include <algorithm>
+#include "MPC_model.h"
+
+FG_analytic::FG_analytic(const MPC_layout& layout,
+                         const std::vector<double>& dt)
+    : N(layout.N), dt(dt), layout(layout) {
+  n_vars = layout.n_vars;
+  n_constraints = layout.n_constraints;
+
+  for (int i = 0; i < 4; i++) {
+    coeffs[i] = 0.0;
+  }
+  ref_v = 0.0;
+
+  // record the structure once
+  std::vector<double> x(n_vars, 0.0);
+  std::vector<double> lambda(n_constraints, 0.0);
+  Jacobian(&x[0], NULL);
+  Hessian(&x[0], 1.0, &lambda[0], NULL);
+}
+
+void FG_analytic::SetParameters(const double* params) {
+  for (int i = 0; i < 4; i++) {
+    coeffs[i] = params[i];
+  }
+  ref_v = params[4];
+}
+
+double FG_analytic::Path(double x) const {
+  return coeffs[0] + coeffs[1] * x + coeffs[2] * x * x + coeffs[3] * x * x * x;
+}
+
+double FG_analytic::PathD1(double x) const {
+  return coeffs[1] + 2 * coeffs[2] * x + 3 * coeffs[3] * x * x;
+}
+
+double FG_analytic::PathD2(double x) const {
+  return 2 * coeffs[2] + 6 * coeffs[3] * x;
+}
+
+double FG_analytic::PathD3() const { return 6 * coeffs[3]; }
+
+void FG_analytic::JacStructure(int* rows, int* cols) const {
+  for (size_t k = 0; k < jac_rows.size(); k++) {
+    rows[k] = jac_rows[k];
+    cols[k] = jac_cols[k];
+  }
+}
+
+void FG_analytic::HesStructure(int* rows, int* cols) const {
+  for (size_t k = 0; k < hes_rows.size(); k++) {
+    rows[k] = hes_rows[k];
+    cols[k] = hes_cols[k];
+  }
+}
+
+double FG_analytic::EvalF(const double* x, bool new_x) {
+  double f = 0.0;
+  for (size_t t = 0; t < N; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    f += weight_cte * x[s.cte] * x[s.cte];
+    f += weight_epsi * x[s.epsi] * x[s.epsi];
+    f += weight_v * (x[s.v] - ref_v) * (x[s.v] - ref_v);
+  }
+  for (size_t t = 0; t < N - 1; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    f += weight_delta * x[s.delta] * x[s.delta];
+    f += weight_a * x[s.a] * x[s.a];
+  }
+  for (size_t t = 0; t < N - 2; t++) {
+    MPC_layout::Stage s0 = layout.Vars(t);
+    MPC_layout::Stage s1 = layout.Vars(t + 1);
+    double rate = RateFactor(dt, t);
+    double ddelta = x[s1.delta] - x[s0.delta];
+    double da = x[s1.a] - x[s0.a];
+    f += weight_delta_diff * rate * ddelta * ddelta;
+    f += weight_a_diff * rate * da * da;
+  }
+  return f;
+}
+
+void FG_analytic::EvalGradF(const double* x, bool new_x, double* grad_f) {
+  for (size_t i = 0; i < n_vars; i++) {
+    grad_f[i] = 0.0;
+  }
+  for (size_t t = 0; t < N; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    grad_f[s.cte] = 2 * weight_cte * x[s.cte];
+    grad_f[s.epsi] = 2 * weight_epsi * x[s.epsi];
+    grad_f[s.v] = 2 * weight_v * (x[s.v] - ref_v);
+  }
+  for (size_t t = 0; t < N - 1; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    // += as the steps of a move block share their actuator
+    grad_f[s.delta] += 2 * weight_delta * x[s.delta];
+    grad_f[s.a] += 2 * weight_a * x[s.a];
+  }
+  for (size_t t = 0; t < N - 2; t++) {
+    MPC_layout::Stage s0 = layout.Vars(t);
+    MPC_layout::Stage s1 = layout.Vars(t + 1);
+    double rate = RateFactor(dt, t);
+    double ddelta = x[s1.delta] - x[s0.delta];
+    double da = x[s1.a] - x[s0.a];
+    grad_f[s1.delta] += 2 * weight_delta_diff * rate * ddelta;
+    grad_f[s0.delta] -= 2 * weight_delta_diff * rate * ddelta;
+    grad_f[s1.a] += 2 * weight_a_diff * rate * da;
+    grad_f[s0.a] -= 2 * weight_a_diff * rate * da;
+  }
+}
+
+void FG_analytic::EvalG(const double* x, bool new_x, double* g) {
+  MPC_layout::Stage s = layout.Vars(0);
+  MPC_layout::Stage r = layout.Rows(0);
+  g[r.x] = x[s.x];
+  g[r.y] = x[s.y];
+  g[r.psi] = x[s.psi];
+  g[r.v] = x[s.v];
+  g[r.cte] = x[s.cte];
+  g[r.epsi] = x[s.epsi];
+
+  for (size_t t = 1; t < N; t++) {
+    MPC_layout::Stage s0 = layout.Vars(t - 1);
+    MPC_layout::Stage s1 = layout.Vars(t);
+    MPC_layout::Stage r1 = layout.Rows(t);
+    double x0 = x[s0.x];
+    double y0 = x[s0.y];
+    double psi0 = x[s0.psi];
+    double v0 = x[s0.v];
+    double epsi0 = x[s0.epsi];
+    double delta0 = x[s0.delta];
+    double a0 = x[s0.a];
+    double psides0 = atan(PathD1(x0));
+    double dt = this->dt[t - 1];
+
+    g[r1.x] = x[s1.x] - (x0 + v0 * cos(psi0) * dt);
+    g[r1.y] = x[s1.y] - (y0 + v0 * sin(psi0) * dt);
+    g[r1.psi] = x[s1.psi] - (psi0 + v0 * (-delta0) / Lf * dt);
+    g[r1.v] = x[s1.v] - (v0 + a0 * dt);
+    g[r1.cte] = x[s1.cte] - ((Path(x0) - y0) + (v0 * sin(epsi0) * dt));
+    g[r1.epsi] = x[s1.epsi] - ((psi0 - psides0) + v0 * (-delta0) / Lf * dt);
+  }
+}
+
+void FG_analytic::EvalJacG(const double* x, bool new_x, double* values) {
+  Jacobian(x, values);
+}
+
+void FG_analytic::EvalH(const double* x, bool new_x, double obj_factor,
+                        const double* lambda, double* values) {
+  Hessian(x, obj_factor, lambda, values);
+}
+
+void FG_analytic::Jacobian(const double* x, double* values) {
+  size_t k = 0;
+  auto entry = [&](size_t row, size_t col, double value) {
+    if (values != NULL) {
+      values[k] = value;
+    } else {
+      jac_rows.push_back(row);
+      jac_cols.push_back(col);
+    }
+    k++;
+  };
+
+  // initial state
+  MPC_layout::Stage s = layout.Vars(0);
+  MPC_layout::Stage r = layout.Rows(0);
+  entry(r.x, s.x, 1.0);
+  entry(r.y, s.y, 1.0);
+  entry(r.psi, s.psi, 1.0);
+  entry(r.v, s.v, 1.0);
+  entry(r.cte, s.cte, 1.0);
+  entry(r.epsi, s.epsi, 1.0);
+
+  // the dynamics of stage t only depend on stages t - 1 and t
+  for (size_t t = 1; t < N; t++) {
+    MPC_layout::Stage s0 = layout.Vars(t - 1);
+    MPC_layout::Stage s1 = layout.Vars(t);
+    MPC_layout::Stage r1 = layout.Rows(t);
+    double x0 = x[s0.x];
+    double psi0 = x[s0.psi];
+    double v0 = x[s0.v];
+    double epsi0 = x[s0.epsi];
+    double delta0 = x[s0.delta];
+    double f1 = PathD1(x0);
+    // d/dx atan(f'(x)) = f''(x) / (1 + f'(x)^2)
+    double dpsides0 = PathD2(x0) / (1 + f1 * f1);
+    double dt = this->dt[t - 1];
+
+    entry(r1.x, s1.x, 1.0);
+    entry(r1.x, s0.x, -1.0);
+    entry(r1.x, s0.psi, v0 * sin(psi0) * dt);
+    entry(r1.x, s0.v, -cos(psi0) * dt);
+
+    entry(r1.y, s1.y, 1.0);
+    entry(r1.y, s0.y, -1.0);
+    entry(r1.y, s0.psi, -v0 * cos(psi0) * dt);
+    entry(r1.y, s0.v, -sin(psi0) * dt);
+
+    entry(r1.psi, s1.psi, 1.0);
+    entry(r1.psi, s0.psi, -1.0);
+    entry(r1.psi, s0.v, delta0 / Lf * dt);
+    entry(r1.psi, s0.delta, v0 / Lf * dt);
+
+    entry(r1.v, s1.v, 1.0);
+    entry(r1.v, s0.v, -1.0);
+    entry(r1.v, s0.a, -dt);
+
+    entry(r1.cte, s1.cte, 1.0);
+    entry(r1.cte, s0.x, -f1);
+    entry(r1.cte, s0.y, 1.0);
+    entry(r1.cte, s0.v, -sin(epsi0) * dt);
+    entry(r1.cte, s0.epsi, -v0 * cos(epsi0) * dt);
+
+    entry(r1.epsi, s1.epsi, 1.0);
+    entry(r1.epsi, s0.x, dpsides0);
+    entry(r1.epsi, s0.psi, -1.0);
+    entry(r1.epsi, s0.v, delta0 / Lf * dt);
+    entry(r1.epsi, s0.delta, v0 / Lf * dt);
+  }
+}
+
+void FG_analytic::Hessian(const double* x, double obj_factor,
+                          const double* lambda, double* values) {
+  size_t k = 0;
+  // the lower triangle, an actuator of a move block may come before the
+  // states of the later stages of the block
+  auto entry = [&](size_t row, size_t col, double value) {
+    if (values != NULL) {
+      values[k] = value;
+    } else {
+      hes_rows.push_back(std::max(row, col));
+      hes_cols.push_back(std::min(row, col));
+    }
+    k++;
+  };
+
+  // Variables of stage t are coupled by the dynamics of stage t + 1 and the
+  // actuators by the rate penalties. Rows are always >= columns given the
+  // order x, y, psi, v, cte, epsi, delta, a within a stage, which both
+  // layouts keep, and the order of the stages.
+  for (size_t t = 0; t < N; t++) {
+    bool last = t == N - 1;
+    MPC_layout::Stage s = layout.Vars(t);
+    double x0 = x[s.x];
+    double psi0 = x[s.psi];
+    double v0 = x[s.v];
+    double epsi0 = x[s.epsi];
+
+    // multipliers of the dynamics constraints of stage t + 1
+    MPC_layout::Stage r1 = layout.Rows(last ? t : t + 1);
+    double l_x = last ? 0.0 : lambda[r1.x];
+    double l_y = last ? 0.0 : lambda[r1.y];
+    double l_psi = last ? 0.0 : lambda[r1.psi];
+    double l_cte = last ? 0.0 : lambda[r1.cte];
+    double l_epsi = last ? 0.0 : lambda[r1.epsi];
+    double dt = last ? 0.0 : this->dt[t];
+
+    if (!last) {
+      // f(x) in the cte constraint and atan(f'(x)) in the epsi constraint
+      double f1 = PathD1(x0);
+      double f2 = PathD2(x0);
+      double q = 1 + f1 * f1;
+      double d2psides0 = (PathD3() * q - 2 * f1 * f2 * f2) / (q * q);
+      entry(s.x, s.x, -l_cte * f2 + l_epsi * d2psides0);
+
+      entry(s.psi, s.psi,
+            (l_x * v0 * cos(psi0) + l_y * v0 * sin(psi0)) * dt);
+      entry(s.v, s.psi, (l_x * sin(psi0) - l_y * cos(psi0)) * dt);
+    }
+    entry(s.v, s.v, obj_factor * 2 * weight_v);
+    entry(s.cte, s.cte, obj_factor * 2 * weight_cte);
+    entry(s.epsi, s.epsi,
+          obj_factor * 2 * weight_epsi + l_cte * v0 * sin(epsi0) * dt);
+    if (last) {
+      continue;
+    }
+    entry(s.epsi, s.v, -l_cte * cos(epsi0) * dt);
+
+    // Actuators, the rate penalties couple t - 1, t and t + 1 unless they
+    // are in the same move block. The steps of a block add up their
+    // entries on the same actuators.
+    bool prev = t >= 1 && layout.block[t - 1] != layout.block[t];
+    bool next = t + 2 < N && layout.block[t + 1] != layout.block[t];
+    double rate_prev = prev ? RateFactor(this->dt, t - 1) : 0.0;
+    double rate_next = next ? RateFactor(this->dt, t) : 0.0;
+    double rate = rate_prev + rate_next;
+    entry(s.delta, s.v, (l_psi + l_epsi) / Lf * dt);
+    entry(s.delta, s.delta,
+          obj_factor * 2 * (weight_delta + rate * weight_delta_diff));
+    if (prev) {
+      entry(s.delta, layout.Actuator(MPC_layout::DELTA, t - 1),
+            -obj_factor * 2 * rate_prev * weight_delta_diff);
+    }
+    entry(s.a, s.a, obj_factor * 2 * (weight_a + rate * weight_a_diff));
+    if (prev) {
+      entry(s.a, layout.Actuator(MPC_layout::A, t - 1),
+            -obj_factor * 2 * rate_prev * weight_a_diff);
+    }
+  }
+}
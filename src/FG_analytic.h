@@ -0,0 +1,62 @@
+#ifndef FG_ANALYTIC_H
+#define FG_ANALYTIC_H
+
+#include <vector>
+#include "FG_backend.h"
+#include "MPC_layout.h"
+
+// Hand-derived derivatives of the cost and constraints of FG_eval.
+//
+// The model is small and fixed (six states, two actuators and a cubic path),
+// so the Jacobian and the Hessian of the Lagrangian are written stage by
+// stage in closed form, straight into the triplet arrays of the solver, in
+// either MPC_layout. `dt` has the lengths of the N - 1 steps.
+class FG_analytic : public FG_backend {
+ public:
+  FG_analytic(const MPC_layout& layout, const std::vector<double>& dt);
+
+  void SetParameters(const double* params);
+
+  size_t NumVars() const { return n_vars; }
+  size_t NumConstraints() const { return n_constraints; }
+
+  size_t JacNonzeros() const { return jac_rows.size(); }
+  size_t HesNonzeros() const { return hes_rows.size(); }
+  void JacStructure(int* rows, int* cols) const;
+  void HesStructure(int* rows, int* cols) const;
+
+  double EvalF(const double* x, bool new_x);
+  void EvalGradF(const double* x, bool new_x, double* grad_f);
+  void EvalG(const double* x, bool new_x, double* g);
+  void EvalJacG(const double* x, bool new_x, double* values);
+  void EvalH(const double* x, bool new_x, double obj_factor,
+             const double* lambda, double* values);
+
+ private:
+  // The entries are produced in the same order for the structure and for
+  // the values. With `values` NULL the structure is appended to the row and
+  // column vectors, `x` and `lambda` are then only used for their size.
+  void Jacobian(const double* x, double* values);
+  void Hessian(const double* x, double obj_factor, const double* lambda,
+               double* values);
+
+  // Path f(x) = k0 + k1 * x + k2 * x^2 + k3 * x^3 and its derivatives.
+  double Path(double x) const;
+  double PathD1(double x) const;
+  double PathD2(double x) const;
+  double PathD3() const;
+
+  size_t N;
+  std::vector<double> dt;
+  MPC_layout layout;
+  size_t n_vars;
+  size_t n_constraints;
+
+  double coeffs[4];
+  double ref_v;
+
+  std::vector<int> jac_rows, jac_cols;
+  std::vector<int> hes_rows, hes_cols;
+};
+
+#endif /* FG_ANALYTIC_H */
@@ -0,0 +1,36 @@
+#ifndef FG_BACKEND_H
+#define FG_BACKEND_H
+
+#include <cstddef>
+
+// Evaluation of the MPC cost, constraints and their derivatives for the
+// solver. Sparse matrices are in triplet form: the Jacobian of the
+// constraints, and the lower triangle of the Hessian of the Lagrangian
+//   obj_factor * cost + sum_i lambda[i] * constraint[i].
+// An entry may be repeated, the values of its triplets add up.
+class FG_backend {
+ public:
+  virtual ~FG_backend() {}
+
+  // Update the polynomial coefficients and the reference velocity, in this
+  // order.
+  virtual void SetParameters(const double* params) = 0;
+
+  virtual size_t NumVars() const = 0;
+  virtual size_t NumConstraints() const = 0;
+
+  virtual size_t JacNonzeros() const = 0;
+  virtual size_t HesNonzeros() const = 0;
+  virtual void JacStructure(int* rows, int* cols) const = 0;
+  virtual void HesStructure(int* rows, int* cols) const = 0;
+
+  // `new_x` is false when `x` is the same as in the previous call.
+  virtual double EvalF(const double* x, bool new_x) = 0;
+  virtual void EvalGradF(const double* x, bool new_x, double* grad_f) = 0;
+  virtual void EvalG(const double* x, bool new_x, double* g) = 0;
+  virtual void EvalJacG(const double* x, bool new_x, double* values) = 0;
+  virtual void EvalH(const double* x, bool new_x, double obj_factor,
+                     const double* lambda, double* values) = 0;
+};
+
+#endif /* FG_BACKEND_H */
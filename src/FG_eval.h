@@ -0,0 +1,177 @@
+#ifndef FG_EVAL_H
+#define FG_EVAL_H
+
+#include <cstddef>
+#include <vector>
+#include "MPC_integrator.h"
+#include "MPC_layout.h"
+#include "MPC_model.h"
+
+// Cost and constraints of the MPC problem.
+//
+// The model is written once for any scalar type with the usual arithmetic
+// and math functions found by argument-dependent lookup: CppAD::AD<double>
+// to record the tape (see MPC.cpp) and the symbolic scalar of mpc_codegen,
+// which emits the derivative kernels of FG_generated at build time.
+//
+// The variables are x, y, psi, v, cte, epsi for each of the N stages and
+// delta and a for the first N - 1 stages, placed by MPC_layout. Step t,
+// from stage t to t + 1, takes dt[t] and is integrated by `integrator`.
+template <class ADvector>
+class FG_eval {
+ public:
+  typedef typename ADvector::value_type Scalar;
+
+  // Horizon, step lengths and the position of the variables and rows.
+  size_t N;
+  std::vector<double> dt;
+  MPC_layout layout;
+  MPC_integrator integrator;
+
+  // Fitted polynomial coefficients and reference velocity. They are dynamic
+  // parameters of the recorded tape, so they can change between solves.
+  ADvector coeffs;
+  Scalar ref_v;
+  FG_eval(const MPC_layout& layout, const std::vector<double>& dt,
+          const ADvector& coeffs, const Scalar& ref_v,
+          const MPC_integrator& integrator = MPC_integrator())
+      : dt(dt), layout(layout), integrator(integrator) {
+    this->N = layout.N;
+    this->coeffs = coeffs;
+    this->ref_v = ref_v;
+  }
+
+  // `fg` is a vector containing the cost and constraints.
+  // `vars` is a vector containing the variable values (state & actuators).
+  void operator()(ADvector& fg, const ADvector& vars) {
+    // TODO: implement MPC
+    // `fg` a vector of the cost constraints, `vars` is a vector of variable values (state & actuators)
+    // NOTE: You'll probably go back and forth between this function and
+    // the Solver function below.
+
+    // The cost is stored is the first element of `fg`.
+    // Any additions to the cost should be added to `fg[0]`.
+    fg[0] = 0;
+
+    // the weights of the cost functions are in MPC_model.h
+
+    // The part of the cost based on the reference state.
+    for (unsigned int t = 0; t < N; t++) {
+      MPC_layout::Stage s = layout.Vars(t);
+      fg[0] += weight_cte * pow(vars[s.cte], 2);
+      fg[0] += weight_epsi * pow(vars[s.epsi], 2);
+      fg[0] += weight_v * pow(vars[s.v] - ref_v, 2);
+    }
+
+    // Minimize the use of actuators.
+    for (unsigned int t = 0; t < N - 1; t++) {
+      MPC_layout::Stage s = layout.Vars(t);
+      fg[0] += weight_delta * pow(vars[s.delta], 2);
+      fg[0] += weight_a * pow(vars[s.a], 2);
+    }
+
+    // Minimize the value gap between sequential actuations.
+    for (unsigned int t = 0; t < N - 2; t++) {
+      MPC_layout::Stage s0 = layout.Vars(t);
+      MPC_layout::Stage s1 = layout.Vars(t + 1);
+      double rate = RateFactor(dt, t);
+      fg[0] += weight_delta_diff * rate *
+               pow(vars[s1.delta] - vars[s0.delta], 2);
+      fg[0] += weight_a_diff * rate * pow(vars[s1.a] - vars[s0.a], 2);
+    }
+
+    //
+    // Setup Constraints
+    //
+    // NOTE: In this section you'll setup the model constraints.
+
+    // Initial constraints
+    //
+    // We add 1 to each of the starting indices due to cost being located at
+    // index 0 of `fg`.
+    // This bumps up the position of all the other values.
+    MPC_layout::Stage s = layout.Vars(0);
+    MPC_layout::Stage r = layout.Rows(0);
+    fg[1 + r.x] = vars[s.x];
+    fg[1 + r.y] = vars[s.y];
+    fg[1 + r.psi] = vars[s.psi];
+    fg[1 + r.v] = vars[s.v];
+    fg[1 + r.cte] = vars[s.cte];
+    fg[1 + r.epsi] = vars[s.epsi];
+
+    // The rest of the constraints
+    for (unsigned int t = 1; t < N; t++) {
+      MPC_layout::Stage s0 = layout.Vars(t - 1);
+      MPC_layout::Stage s1 = layout.Vars(t);
+      MPC_layout::Stage r1 = layout.Rows(t);
+
+      // The state at time t+1 .
+      Scalar x1 = vars[s1.x];
+      Scalar y1 = vars[s1.y];
+      Scalar psi1 = vars[s1.psi];
+      Scalar v1 = vars[s1.v];
+      Scalar cte1 = vars[s1.cte];
+      Scalar epsi1 = vars[s1.epsi];
+
+      // The state at time t.
+      Scalar x0 = vars[s0.x];
+      Scalar y0 = vars[s0.y];
+      Scalar psi0 = vars[s0.psi];
+      Scalar v0 = vars[s0.v];
+      Scalar epsi0 = vars[s0.epsi];
+
+      // Only consider the actuation at time t.
+      Scalar delta0 = vars[s0.delta];
+      Scalar a0 = vars[s0.a];
+
+      // note that we are using the 3rd order polynomial now.
+      // f = k0 + k1*x + k2*x^2 + k3*x^3
+      // psi_des = atan (f') = atan (k1 + 2*k2*x + 3*k3*x^2)
+      Scalar f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] * pow(x0, 2) + coeffs[3] * pow(x0, 3);
+      Scalar psides0 = atan(coeffs[1] + 2 * coeffs[2] * x0 + 3 * coeffs[3] * pow(x0, 2));
+
+      // length of this step
+      double dt = this->dt[t - 1];
+
+      // Here's `x` to get you started.
+      // The idea here is to constraint this value to be 0.
+      //
+      // Recall the equations for the model:
+      // x_[t+1] = x[t] + v[t] * cos(psi[t]) * dt
+      // y_[t+1] = y[t] + v[t] * sin(psi[t]) * dt
+      // psi_[t+1] = psi[t] + v[t] / Lf * delta[t] * dt
+      // v_[t+1] = v[t] + a[t] * dt
+      // cte[t+1] = f(x[t]) - y[t] + v[t] * sin(epsi[t]) * dt
+      // epsi[t+1] = psi[t] - psides[t] + v[t] * delta[t] / Lf * dt
+
+      //Note if delta is positive we rotate counter-clockwise, or turn left.
+      // In the simulator however, a positive value implies a right turn and
+      // a negative value implies a left turn. This is why we update the (delta0)
+      // as (-delta0) in the following equations
+      if (integrator.Euler()) {
+        fg[1 + r1.x] = x1 - (x0 + v0 * cos(psi0) * dt);
+        fg[1 + r1.y] = y1 - (y0 + v0 * sin(psi0) * dt);
+        fg[1 + r1.psi] = psi1 - (psi0 + v0 * (-delta0) / Lf * dt);
+        fg[1 + r1.v] = v1 - (v0 + a0 * dt);
+        fg[1 + r1.cte] =
+                cte1 - ((f0 - y0) + (v0 * sin(epsi0) * dt));
+        fg[1 + r1.epsi] =
+                epsi1 - ((psi0 - psides0) + v0 * (-delta0) / Lf * dt);
+        continue;
+      }
+
+      // the same model integrated in substeps or with a higher order
+      Scalar z[6] = {x0, y0, psi0, v0, f0 - y0, psi0 - psides0};
+      integrator.Step(z, delta0, a0, dt);
+      fg[1 + r1.x] = x1 - z[0];
+      fg[1 + r1.y] = y1 - z[1];
+      fg[1 + r1.psi] = psi1 - z[2];
+      fg[1 + r1.v] = v1 - z[3];
+      fg[1 + r1.cte] = cte1 - z[4];
+      fg[1 + r1.epsi] = epsi1 - z[5];
+    }
+
+  }
+};
+
+#endif /* FG_EVAL_H */
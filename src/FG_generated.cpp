@@ -0,0 +1,48 @@
+#include "FG_generated.h"
+
+FG_generated::FG_generated() {
+  for (int i = 0; i < 5; i++) {
+    params[i] = 0.0;
+  }
+}
+
+void FG_generated::SetParameters(const double* params) {
+  for (int i = 0; i < 5; i++) {
+    this->params[i] = params[i];
+  }
+}
+
+void FG_generated::JacStructure(int* rows, int* cols) const {
+  for (size_t k = 0; k < fg_kernels::jac_nnz; k++) {
+    rows[k] = fg_kernels::jac_rows[k];
+    cols[k] = fg_kernels::jac_cols[k];
+  }
+}
+
+void FG_generated::HesStructure(int* rows, int* cols) const {
+  for (size_t k = 0; k < fg_kernels::hes_nnz; k++) {
+    rows[k] = fg_kernels::hes_rows[k];
+    cols[k] = fg_kernels::hes_cols[k];
+  }
+}
+
+double FG_generated::EvalF(const double* x, bool new_x) {
+  return fg_kernels::F(x, params);
+}
+
+void FG_generated::EvalGradF(const double* x, bool new_x, double* grad_f) {
+  fg_kernels::GradF(x, params, grad_f);
+}
+
+void FG_generated::EvalG(const double* x, bool new_x, double* g) {
+  fg_kernels::G(x, params, g);
+}
+
+void FG_generated::EvalJacG(const double* x, bool new_x, double* values) {
+  fg_kernels::JacG(x, params, values);
+}
+
+void FG_generated::EvalH(const double* x, bool new_x, double obj_factor,
+                         const double* lambda, double* values) {
+  fg_kernels::H(x, params, obj_factor, lambda, values);
+}
@@ -0,0 +1,57 @@
+#ifndef FG_GENERATED_H
+#define FG_GENERATED_H
+
+#include <cstddef>
+#include "FG_backend.h"
+
+// Kernels written by mpc_codegen (src/codegen.cpp) into fg_kernels.cpp at
+// build time. They are straight-line code for the horizon N and the step
+// length dt of MPC_model.h and the variable-major MPC_layout; `p` holds the
+// polynomial coefficients and the reference velocity.
+namespace fg_kernels {
+
+extern const size_t n_vars;
+extern const size_t n_constraints;
+extern const size_t jac_nnz;
+extern const int jac_rows[];
+extern const int jac_cols[];
+extern const size_t hes_nnz;
+extern const int hes_rows[];
+extern const int hes_cols[];
+
+double F(const double* x, const double* p);
+void GradF(const double* x, const double* p, double* grad_f);
+void G(const double* x, const double* p, double* g);
+void JacG(const double* x, const double* p, double* values);
+void H(const double* x, const double* p, double obj_factor,
+       const double* lambda, double* values);
+
+}  // namespace fg_kernels
+
+// Evaluation backend running the generated kernels, no tape is involved.
+class FG_generated : public FG_backend {
+ public:
+  FG_generated();
+
+  void SetParameters(const double* params);
+
+  size_t NumVars() const { return fg_kernels::n_vars; }
+  size_t NumConstraints() const { return fg_kernels::n_constraints; }
+
+  size_t JacNonzeros() const { return fg_kernels::jac_nnz; }
+  size_t HesNonzeros() const { return fg_kernels::hes_nnz; }
+  void JacStructure(int* rows, int* cols) const;
+  void HesStructure(int* rows, int* cols) const;
+
+  double EvalF(const double* x, bool new_x);
+  void EvalGradF(const double* x, bool new_x, double* grad_f);
+  void EvalG(const double* x, bool new_x, double* g);
+  void EvalJacG(const double* x, bool new_x, double* values);
+  void EvalH(const double* x, bool new_x, double obj_factor,
+             const double* lambda, double* values);
+
+ private:
+  double params[5];
+};
+
+#endif /* FG_GENERATED_H */
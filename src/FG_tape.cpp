@@ -0,0 +1,164 @@
+#include "FG_tape.h"
+
+using CppAD::sparse_rc;
+using CppAD::sparse_rcv;
+
+FG_tape::FG_tape(ADvector& vars, ADvector& fg)
+    : n_vars(vars.size()),
+      n_constraints(fg.size() - 1),
+      x_val(vars.size()),
+      fg_val(fg.size()),
+      fg_valid(false),
+      hes_weight(fg.size()) {
+  // stop the recording and drop the operations that do not affect `fg`
+  fg_fun.Dependent(vars, fg);
+  fg_fun.optimize();
+
+  // Jacobian sparsity of the whole `fg` vector, the identity is the seed
+  sparse_rc<Svector> identity(n_vars, n_vars, n_vars);
+  for (size_t k = 0; k < n_vars; k++) {
+    identity.set(k, k, k);
+  }
+  fg_fun.for_jac_sparsity(identity, false, false, true, jac_pattern);
+
+  // the solver only asks for the constraint rows, the cost row is the
+  // gradient which is computed with a reverse sweep
+  size_t nnz = 0;
+  for (size_t k = 0; k < jac_pattern.nnz(); k++) {
+    if (jac_pattern.row()[k] > 0) {
+      nnz++;
+    }
+  }
+  sparse_rc<Svector> jac_rc(n_constraints + 1, n_vars, nnz);
+  nnz = 0;
+  for (size_t k = 0; k < jac_pattern.nnz(); k++) {
+    if (jac_pattern.row()[k] > 0) {
+      jac_rc.set(nnz++, jac_pattern.row()[k], jac_pattern.col()[k]);
+    }
+  }
+  jac_subset = sparse_rcv<Svector, Dvector>(jac_rc);
+
+  // Hessian sparsity of the Lagrangian, the cost and all the constraints
+  // enter with a multiplier
+  CPPAD_TESTVECTOR(bool) select_domain(n_vars);
+  CPPAD_TESTVECTOR(bool) select_range(n_constraints + 1);
+  for (size_t j = 0; j < n_vars; j++) {
+    select_domain[j] = true;
+  }
+  for (size_t i = 0; i <= n_constraints; i++) {
+    select_range[i] = true;
+  }
+  fg_fun.for_hes_sparsity(select_domain, select_range, true, hes_pattern);
+
+  // Ipopt expects the lower triangle only
+  nnz = 0;
+  for (size_t k = 0; k < hes_pattern.nnz(); k++) {
+    if (hes_pattern.row()[k] >= hes_pattern.col()[k]) {
+      nnz++;
+    }
+  }
+  sparse_rc<Svector> hes_rc(n_vars, n_vars, nnz);
+  nnz = 0;
+  for (size_t k = 0; k < hes_pattern.nnz(); k++) {
+    if (hes_pattern.row()[k] >= hes_pattern.col()[k]) {
+      hes_rc.set(nnz++, hes_pattern.row()[k], hes_pattern.col()[k]);
+    }
+  }
+  hes_subset = sparse_rcv<Svector, Dvector>(hes_rc);
+}
+
+void FG_tape::SetParameters(const double* params) {
+  Dvector p(fg_fun.size_dyn_ind());
+  for (size_t i = 0; i < p.size(); i++) {
+    p[i] = params[i];
+  }
+  fg_fun.new_dynamic(p);
+  fg_valid = false;
+}
+
+void FG_tape::JacStructure(int* rows, int* cols) const {
+  for (size_t k = 0; k < jac_subset.nnz(); k++) {
+    // row 0 of the tape is the cost
+    rows[k] = jac_subset.row()[k] - 1;
+    cols[k] = jac_subset.col()[k];
+  }
+}
+
+void FG_tape::HesStructure(int* rows, int* cols) const {
+  for (size_t k = 0; k < hes_subset.nnz(); k++) {
+    rows[k] = hes_subset.row()[k];
+    cols[k] = hes_subset.col()[k];
+  }
+}
+
+void FG_tape::Forward0(const double* x, bool new_x) {
+  for (size_t j = 0; j < n_vars; j++) {
+    x_val[j] = x[j];
+  }
+  if (new_x) {
+    fg_valid = false;
+  }
+  if (!fg_valid) {
+    fg_val = fg_fun.Forward(0, x_val);
+    fg_valid = true;
+  }
+}
+
+double FG_tape::EvalF(const double* x, bool new_x) {
+  Forward0(x, new_x);
+  return fg_val[0];
+}
+
+void FG_tape::EvalGradF(const double* x, bool new_x, double* grad_f) {
+  // the sparse sweeps below leave other Taylor coefficients behind, so the
+  // reverse sweep always gets a fresh zero order sweep
+  Forward0(x, true);
+  Dvector w(n_constraints + 1);
+  for (size_t i = 0; i <= n_constraints; i++) {
+    w[i] = 0.0;
+  }
+  w[0] = 1.0;
+  Dvector grad = fg_fun.Reverse(1, w);
+  for (size_t j = 0; j < n_vars; j++) {
+    grad_f[j] = grad[j];
+  }
+}
+
+void FG_tape::EvalG(const double* x, bool new_x, double* g) {
+  Forward0(x, new_x);
+  for (size_t i = 0; i < n_constraints; i++) {
+    g[i] = fg_val[1 + i];
+  }
+}
+
+void FG_tape::EvalJacG(const double* x, bool new_x, double* values) {
+  for (size_t j = 0; j < n_vars; j++) {
+    x_val[j] = x[j];
+  }
+  if (new_x) {
+    fg_valid = false;
+  }
+  fg_fun.sparse_jac_rev(x_val, jac_subset, jac_pattern, "cppad", jac_work);
+  for (size_t k = 0; k < jac_subset.nnz(); k++) {
+    values[k] = jac_subset.val()[k];
+  }
+}
+
+void FG_tape::EvalH(const double* x, bool new_x, double obj_factor,
+                    const double* lambda, double* values) {
+  for (size_t j = 0; j < n_vars; j++) {
+    x_val[j] = x[j];
+  }
+  if (new_x) {
+    fg_valid = false;
+  }
+  hes_weight[0] = obj_factor;
+  for (size_t i = 0; i < n_constraints; i++) {
+    hes_weight[1 + i] = lambda[i];
+  }
+  fg_fun.sparse_hes(x_val, hes_weight, hes_subset, hes_pattern,
+                    "cppad.symmetric", hes_work);
+  for (size_t k = 0; k < hes_subset.nnz(); k++) {
+    values[k] = hes_subset.val()[k];
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef FG_TAPE_H
+#define FG_TAPE_H
+
+#include <cppad/cppad.hpp>
+#include "FG_backend.h"
+
+// Operation sequence of FG_eval recorded once, together with the sparsity
+// patterns and colorings of its derivatives.
+//
+// The polynomial coefficients and the reference velocity are dynamic
+// parameters of the tape, so a new control tick only has to update them
+// instead of re-taping the cost and constraints.
+class FG_tape : public FG_backend {
+ public:
+  typedef CPPAD_TESTVECTOR(CppAD::AD<double>) ADvector;
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+  typedef CPPAD_TESTVECTOR(size_t) Svector;
+
+  // `vars` and `fg` are the independent variables and the evaluated cost and
+  // constraints of an active recording (see CppAD::Independent). This stops
+  // the recording.
+  FG_tape(ADvector& vars, ADvector& fg);
+
+  // Update the dynamic parameters (polynomial coefficients, reference velocity).
+  void SetParameters(const double* params);
+
+  size_t NumVars() const { return n_vars; }
+  size_t NumConstraints() const { return n_constraints; }
+
+  // Structure of the constraint Jacobian and of the lower triangle of the
+  // Lagrangian Hessian, in triplet form.
+  size_t JacNonzeros() const { return jac_subset.nnz(); }
+  size_t HesNonzeros() const { return hes_subset.nnz(); }
+  void JacStructure(int* rows, int* cols) const;
+  void HesStructure(int* rows, int* cols) const;
+
+  double EvalF(const double* x, bool new_x);
+  void EvalGradF(const double* x, bool new_x, double* grad_f);
+  void EvalG(const double* x, bool new_x, double* g);
+  void EvalJacG(const double* x, bool new_x, double* values);
+  void EvalH(const double* x, bool new_x, double obj_factor,
+             const double* lambda, double* values);
+
+ private:
+  // Zero order forward sweep, cached until `x` changes.
+  void Forward0(const double* x, bool new_x);
+
+  CppAD::ADFun<double> fg_fun;
+  size_t n_vars;
+  size_t n_constraints;
+
+  Dvector x_val;
+  Dvector fg_val;
+  bool fg_valid;
+
+  // Jacobian of the constraints (rows 1 .. n_constraints of the tape).
+  CppAD::sparse_rc<Svector> jac_pattern;
+  CppAD::sparse_rcv<Svector, Dvector> jac_subset;
+  CppAD::sparse_jac_work jac_work;
+
+  // Lower triangle of the Hessian of the Lagrangian.
+  Dvector hes_weight;
+  CppAD::sparse_rc<Svector> hes_pattern;
+  CppAD::sparse_rcv<Svector, Dvector> hes_subset;
+  CppAD::sparse_hes_work hes_work;
+};
+
+#endif /* FG_TAPE_H */
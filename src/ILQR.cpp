@@ -0,0 +1,281 @@
+#include "ILQR.h"
+#include <math.h>
+#include <algorithm>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "MPC_model.h"
+#include "QP_box.h"
+
+using namespace std;
+
+ILQR::ILQR(size_t N, const vector<double>& dt)
+    : x(N), u(N - 1), dt(dt), k(N - 1), K(N - 1), x_new(N), u_new(N - 1) {
+  this->N = N;
+  for (int i = 0; i < 4; i++) {
+    coeffs[i] = 0.0;
+  }
+  ref_v = 0.0;
+  for (size_t t = 0; t < N - 1; t++) {
+    u[t].setZero();
+    k[t].setZero();
+  }
+  cost = 0.0;
+  iterations = 0;
+  // the iterations are cheap and every iterate is feasible, usually the
+  // deadline ends a slow solve first
+  max_iterations = 500;
+  tolerance = 1e-6;
+}
+
+void ILQR::SetParameters(const double* params) {
+  for (int i = 0; i < 4; i++) {
+    coeffs[i] = params[i];
+  }
+  ref_v = params[4];
+}
+
+double ILQR::Path(double x) const {
+  return coeffs[0] + coeffs[1] * x + coeffs[2] * x * x + coeffs[3] * x * x * x;
+}
+
+double ILQR::PathD1(double x) const {
+  return coeffs[1] + 2 * coeffs[2] * x + 3 * coeffs[3] * x * x;
+}
+
+double ILQR::PathD2(double x) const {
+  return 2 * coeffs[2] + 6 * coeffs[3] * x;
+}
+
+// The model of FG_eval, delta is negated for the simulator.
+ILQR::State ILQR::Step(size_t t, const State& x, const Control& u) const {
+  const double dt = this->dt[t];
+  State next;
+  next[0] = x[0] + x[3] * cos(x[2]) * dt;
+  next[1] = x[1] + x[3] * sin(x[2]) * dt;
+  next[2] = x[2] + x[3] * (-u[0]) / Lf * dt;
+  next[3] = x[3] + u[1] * dt;
+  next[4] = (Path(x[0]) - x[1]) + x[3] * sin(x[5]) * dt;
+  next[5] = (x[2] - atan(PathD1(x[0]))) + x[3] * (-u[0]) / Lf * dt;
+  next.tail<NU>() = u;
+  return next;
+}
+
+void ILQR::Linearize(size_t t, const State& x, const Control& u,
+                     MatrixXX& A, MatrixXU& B) const {
+  const double dt = this->dt[t];
+  double f1 = PathD1(x[0]);
+  A.setZero();
+  A(0, 0) = 1.0;
+  A(0, 2) = -x[3] * sin(x[2]) * dt;
+  A(0, 3) = cos(x[2]) * dt;
+  A(1, 1) = 1.0;
+  A(1, 2) = x[3] * cos(x[2]) * dt;
+  A(1, 3) = sin(x[2]) * dt;
+  A(2, 2) = 1.0;
+  A(2, 3) = -u[0] / Lf * dt;
+  A(3, 3) = 1.0;
+  A(4, 0) = f1;
+  A(4, 1) = -1.0;
+  A(4, 3) = sin(x[5]) * dt;
+  A(4, 5) = x[3] * cos(x[5]) * dt;
+  // d/dx atan(f'(x)) = f''(x) / (1 + f'(x)^2)
+  A(5, 0) = -PathD2(x[0]) / (1 + f1 * f1);
+  A(5, 2) = 1.0;
+  A(5, 3) = -u[0] / Lf * dt;
+
+  B.setZero();
+  B(2, 0) = -x[3] / Lf * dt;
+  B(3, 1) = dt;
+  B(5, 0) = -x[3] / Lf * dt;
+  B(6, 0) = 1.0;
+  B(7, 1) = 1.0;
+}
+
+// The terms of FG_eval that involve stage t. The rate penalties start with
+// the second actuation, the first one has no predecessor in the horizon.
+double ILQR::StageCost(size_t t, const State& x, const Control& u) const {
+  double c = weight_cte * x[4] * x[4] + weight_epsi * x[5] * x[5] +
+             weight_v * (x[3] - ref_v) * (x[3] - ref_v);
+  if (t < N - 1) {
+    c += weight_delta * u[0] * u[0] + weight_a * u[1] * u[1];
+    if (t > 0) {
+      double rate = RateFactor(dt, t - 1);
+      c += rate * (weight_delta_diff * (u[0] - x[6]) * (u[0] - x[6]) +
+                   weight_a_diff * (u[1] - x[7]) * (u[1] - x[7]));
+    }
+  }
+  return c;
+}
+
+void ILQR::StageDerivatives(size_t t, const State& x, const Control& u,
+                            State& l_x, Control& l_u, MatrixXX& l_xx,
+                            MatrixUU& l_uu, MatrixUX& l_ux) const {
+  l_x.setZero();
+  l_u.setZero();
+  l_xx.setZero();
+  l_uu.setZero();
+  l_ux.setZero();
+  l_x[3] = 2 * weight_v * (x[3] - ref_v);
+  l_x[4] = 2 * weight_cte * x[4];
+  l_x[5] = 2 * weight_epsi * x[5];
+  l_xx(3, 3) = 2 * weight_v;
+  l_xx(4, 4) = 2 * weight_cte;
+  l_xx(5, 5) = 2 * weight_epsi;
+  if (t == N - 1) {
+    return;
+  }
+  l_u[0] = 2 * weight_delta * u[0];
+  l_u[1] = 2 * weight_a * u[1];
+  l_uu(0, 0) = 2 * weight_delta;
+  l_uu(1, 1) = 2 * weight_a;
+  if (t > 0) {
+    double rate = RateFactor(dt, t - 1);
+    const double w[NU] = {rate * weight_delta_diff, rate * weight_a_diff};
+    for (int j = 0; j < NU; j++) {
+      double diff = u[j] - x[6 + j];
+      l_u[j] += 2 * w[j] * diff;
+      l_x[6 + j] = -2 * w[j] * diff;
+      l_uu(j, j) += 2 * w[j];
+      l_xx(6 + j, 6 + j) = 2 * w[j];
+      l_ux(j, 6 + j) = -2 * w[j];
+    }
+  }
+}
+
+bool ILQR::Backward(double regularization) {
+  const double bound[NU] = {delta_max, a_max};
+  MatrixXX A, l_xx;
+  MatrixXU B;
+  State l_x;
+  Control l_u;
+  MatrixUU l_uu;
+  MatrixUX l_ux;
+
+  // value function of the last stage
+  StageDerivatives(N - 1, x[N - 1], Control::Zero(), l_x, l_u, l_xx, l_uu,
+                   l_ux);
+  State V_x = l_x;
+  MatrixXX V_xx = l_xx;
+
+  for (size_t t = N - 1; t-- > 0;) {
+    Linearize(t, x[t], u[t], A, B);
+    StageDerivatives(t, x[t], u[t], l_x, l_u, l_xx, l_uu, l_ux);
+    State Q_x = l_x + A.transpose() * V_x;
+    Control Q_u = l_u + B.transpose() * V_x;
+    MatrixXX Q_xx = l_xx + A.transpose() * V_xx * A;
+    MatrixUU Q_uu = l_uu + B.transpose() * V_xx * B;
+    MatrixUX Q_ux = l_ux + B.transpose() * V_xx * A;
+    Q_uu.diagonal().array() += regularization;
+    if (Q_uu.llt().info() != Eigen::Success) {
+      return false;
+    }
+
+    // feedforward step within the bounds, from the last one
+    Eigen::MatrixXd H = Q_uu;
+    Eigen::VectorXd g = Q_u;
+    Eigen::VectorXd lb(NU), ub(NU);
+    Eigen::VectorXd step = k[t];
+    for (int j = 0; j < NU; j++) {
+      lb[j] = -bound[j] - u[t][j];
+      ub[j] = bound[j] - u[t][j];
+    }
+    if (SolveBoxQP(H, g, lb, ub, step) < 0) {
+      return false;
+    }
+    k[t] = step;
+
+    // feedback on the actuators that are not clamped
+    K[t].setZero();
+    vector<int> free;
+    for (int j = 0; j < NU; j++) {
+      if (step[j] > lb[j] && step[j] < ub[j]) {
+        free.push_back(j);
+      }
+    }
+    if (free.size() == NU) {
+      K[t] = -Q_uu.llt().solve(Q_ux);
+    } else if (free.size() == 1) {
+      int j = free[0];
+      K[t].row(j) = -Q_ux.row(j) / Q_uu(j, j);
+    }
+
+    V_x = Q_x + K[t].transpose() * Q_uu * k[t] + K[t].transpose() * Q_u +
+          Q_ux.transpose() * k[t];
+    V_xx = Q_xx + K[t].transpose() * Q_uu * K[t] +
+           K[t].transpose() * Q_ux + Q_ux.transpose() * K[t];
+    V_xx = 0.5 * (V_xx + V_xx.transpose()).eval();
+  }
+  return true;
+}
+
+double ILQR::Forward(double alpha) {
+  const Control bound(delta_max, a_max);
+  double c = 0.0;
+  x_new[0] = x[0];
+  for (size_t t = 0; t < N - 1; t++) {
+    u_new[t] = u[t] + alpha * k[t] + K[t] * (x_new[t] - x[t]);
+    u_new[t] = u_new[t].cwiseMax(-bound).cwiseMin(bound);
+    c += StageCost(t, x_new[t], u_new[t]);
+    x_new[t + 1] = Step(t, x_new[t], u_new[t]);
+  }
+  c += StageCost(N - 1, x_new[N - 1], Control::Zero());
+  return c;
+}
+
+int ILQR::Solve(const Eigen::VectorXd& x0,
+                const function<bool()>& stopped) {
+  // roll out the starting guess, there is no actuation before the horizon
+  x[0].head<6>() = x0.head<6>();
+  x[0].tail<NU>().setZero();
+  for (size_t t = 0; t < N - 1; t++) {
+    k[t].setZero();
+    K[t].setZero();
+  }
+  cost = Forward(0.0);
+  x.swap(x_new);
+  u.swap(u_new);
+
+  double regularization = 0.0;
+  for (iterations = 1; iterations <= max_iterations; iterations++) {
+    // a failed pass is repeated with more regularization of the control
+    // Hessians, a successful one relaxes it
+    double accepted = -1.0;
+    double c = cost;
+    if (Backward(regularization)) {
+      for (double alpha = 1.0; alpha > 1e-3; alpha *= 0.5) {
+        c = Forward(alpha);
+        if (c < cost) {
+          accepted = alpha;
+          break;
+        }
+      }
+    }
+    if (accepted < 0) {
+      // no decrease along a vanishing step, this is the optimum
+      double step = 0.0;
+      for (size_t t = 0; t < N - 1; t++) {
+        step = max(step, k[t].cwiseAbs().maxCoeff());
+      }
+      if (step < 1e-9) {
+        return iterations;
+      }
+      regularization = max(10.0 * regularization, 1e-6);
+      if (regularization > 1e6) {
+        return -1;
+      }
+    } else {
+      double decrease = cost - c;
+      x.swap(x_new);
+      u.swap(u_new);
+      cost = c;
+      regularization = regularization > 1e-6 ? 0.1 * regularization : 0.0;
+      if (decrease < tolerance * cost) {
+        return iterations;
+      }
+    }
+    if (stopped()) {
+      return -1;
+    }
+  }
+  iterations = max_iterations;
+  return -1;
+}
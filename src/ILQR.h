@@ -0,0 +1,91 @@
+#ifndef ILQR_H
+#define ILQR_H
+
+#include <functional>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/StdVector"
+
+// Iterative LQR on the cost and the kinematic model of FG_eval.
+//
+// The actuations are the only unknowns: every iteration runs a backward
+// Riccati pass on the linearized model and the quadratic cost, then a
+// forward rollout through the model with a line search on the feedforward
+// terms. The actuator bounds are handled as in box-DDP, the feedforward
+// term of each stage is a small box QP and the clamped actuators get no
+// feedback. The second derivatives of the model are left out (iLQR, not
+// full DDP).
+//
+// The state is x, y, psi, v, cte, epsi, followed by the previous actuation
+// so that the rate penalties are stage costs. Memory and work per iteration
+// are O(N) on 8 x 8 and 8 x 2 blocks. Step t takes dt[t].
+class ILQR {
+ public:
+  static const int NX = 8;
+  static const int NU = 2;
+  typedef Eigen::Matrix<double, NX, 1> State;
+  typedef Eigen::Matrix<double, NU, 1> Control;
+
+  ILQR(size_t N, const std::vector<double>& dt);
+
+  // Polynomial coefficients of the path and reference velocity.
+  void SetParameters(const double* params);
+
+  // Optimize the actuations `u` (the starting guess) from the initial state
+  // `x0` (x, y, psi, v, cte, epsi) until the cost stalls or `stopped`
+  // returns true after an iteration, e.g. at a deadline or on a cancel.
+  // Returns the number of iterations, or -1 without convergence. `x` and
+  // `u` are then the last accepted trajectory.
+  int Solve(const Eigen::VectorXd& x0, const std::function<bool()>& stopped);
+
+  std::vector<State, Eigen::aligned_allocator<State> > x;
+  std::vector<Control, Eigen::aligned_allocator<Control> > u;
+  double cost;
+  // iterations of the last call of Solve
+  int iterations;
+
+  int max_iterations;
+  // relative cost decrease below which the iteration stops
+  double tolerance;
+
+ private:
+  typedef Eigen::Matrix<double, NX, NX> MatrixXX;
+  typedef Eigen::Matrix<double, NX, NU> MatrixXU;
+  typedef Eigen::Matrix<double, NU, NX> MatrixUX;
+  typedef Eigen::Matrix<double, NU, NU> MatrixUU;
+
+  // Model step t and its Jacobians.
+  State Step(size_t t, const State& x, const Control& u) const;
+  void Linearize(size_t t, const State& x, const Control& u, MatrixXX& A,
+                 MatrixXU& B) const;
+
+  // Cost of stage t; the last stage has no actuation.
+  double StageCost(size_t t, const State& x, const Control& u) const;
+  void StageDerivatives(size_t t, const State& x, const Control& u,
+                        State& l_x, Control& l_u, MatrixXX& l_xx,
+                        MatrixUU& l_uu, MatrixUX& l_ux) const;
+
+  // Backward pass, false when a control Hessian is not positive definite.
+  bool Backward(double regularization);
+  // Rollout with the step `alpha` of the feedforward terms, returns its
+  // cost.
+  double Forward(double alpha);
+
+  double Path(double x) const;
+  double PathD1(double x) const;
+  double PathD2(double x) const;
+
+  size_t N;
+  std::vector<double> dt;
+  double coeffs[4];
+  double ref_v;
+
+  // feedforward terms and feedback gains of the backward pass
+  std::vector<Control, Eigen::aligned_allocator<Control> > k;
+  std::vector<MatrixUX, Eigen::aligned_allocator<MatrixUX> > K;
+  // trajectory of the forward pass
+  std::vector<State, Eigen::aligned_allocator<State> > x_new;
+  std::vector<Control, Eigen::aligned_allocator<Control> > u_new;
+};
+
+#endif /* ILQR_H */
@@ -0,0 +1,122 @@
+#include "KKT_ldlt.h"
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+using Ipopt::ESymSolverStatus;
+using Ipopt::Index;
+
+KKT_ldlt::KKT_ldlt() {
+  analyses = 0;
+  factorizations = 0;
+  factored = false;
+  negative = 0;
+}
+
+bool KKT_ldlt::InitializeImpl(const Ipopt::OptionsList& options,
+                              const string& prefix) {
+  return true;
+}
+
+ESymSolverStatus KKT_ldlt::InitializeStructure(Index dim, Index nonzeros,
+                                               const Index* ia,
+                                               const Index* ja) {
+  values.resize(nonzeros);
+  factored = false;
+  bool same = matrix.rows() == dim && rows.size() == (size_t)nonzeros &&
+              equal(rows.begin(), rows.end(), ia) &&
+              equal(cols.begin(), cols.end(), ja);
+  if (same) {
+    return Ipopt::SYMSOLVER_SUCCESS;
+  }
+  rows.assign(ia, ia + nonzeros);
+  cols.assign(ja, ja + nonzeros);
+
+  // lower triangle, setFromTriplets sorts the rows of each column
+  vector<Eigen::Triplet<double> > triplets;
+  triplets.reserve(nonzeros);
+  for (Index k = 0; k < nonzeros; k++) {
+    triplets.push_back(Eigen::Triplet<double>(
+        max(ia[k], ja[k]) - 1, min(ia[k], ja[k]) - 1, 1.0));
+  }
+  matrix.resize(dim, dim);
+  matrix.setFromTriplets(triplets.begin(), triplets.end());
+
+  position.resize(nonzeros);
+  const int* inner = matrix.innerIndexPtr();
+  const int* outer = matrix.outerIndexPtr();
+  for (Index k = 0; k < nonzeros; k++) {
+    int row = max(ia[k], ja[k]) - 1;
+    int col = min(ia[k], ja[k]) - 1;
+    position[k] =
+        lower_bound(inner + outer[col], inner + outer[col + 1], row) - inner;
+  }
+
+  ldlt.analyzePattern(matrix);
+  analyses++;
+  return Ipopt::SYMSOLVER_SUCCESS;
+}
+
+double* KKT_ldlt::GetValuesArrayPtr() { return values.data(); }
+
+ESymSolverStatus KKT_ldlt::Factor() {
+  double* value = matrix.valuePtr();
+  fill(value, value + matrix.nonZeros(), 0.0);
+  for (size_t k = 0; k < values.size(); k++) {
+    value[position[k]] += values[k];
+  }
+  ldlt.factorize(matrix);
+  factorizations++;
+  factored = false;
+  if (ldlt.info() != Eigen::Success) {
+    return Ipopt::SYMSOLVER_SINGULAR;
+  }
+
+  // pivots that vanish next to the entries of the matrix are taken as zero
+  double scale = matrix.coeffs().cwiseAbs().maxCoeff();
+  const Eigen::VectorXd& d = ldlt.vectorD();
+  negative = 0;
+  for (int i = 0; i < d.size(); i++) {
+    if (!(fabs(d[i]) > 1e-14 * scale)) {
+      return Ipopt::SYMSOLVER_SINGULAR;
+    }
+    if (d[i] < 0) {
+      negative++;
+    }
+  }
+  factored = true;
+  return Ipopt::SYMSOLVER_SUCCESS;
+}
+
+ESymSolverStatus KKT_ldlt::MultiSolve(bool new_matrix, const Index* ia,
+                                      const Index* ja, Index nrhs,
+                                      double* rhs_vals, bool check_NegEVals,
+                                      Index numberOfNegEVals) {
+  if (new_matrix || !factored) {
+    ESymSolverStatus status = Factor();
+    if (status != Ipopt::SYMSOLVER_SUCCESS) {
+      return status;
+    }
+  }
+  if (check_NegEVals && negative != numberOfNegEVals) {
+    return Ipopt::SYMSOLVER_WRONG_INERTIA;
+  }
+
+  const Index dim = matrix.rows();
+  for (Index j = 0; j < nrhs; j++) {
+    Eigen::Map<Eigen::VectorXd> rhs(rhs_vals + j * dim, dim);
+    Eigen::VectorXd solution = ldlt.solve(rhs);
+    rhs = solution;
+  }
+  return Ipopt::SYMSOLVER_SUCCESS;
+}
+
+Index KKT_ldlt::NumberOfNegEVals() const { return negative; }
+
+bool KKT_ldlt::IncreaseQuality() { return false; }
+
+bool KKT_ldlt::ProvidesInertia() const { return true; }
+
+KKT_ldlt::EMatrixFormat KKT_ldlt::MatrixFormat() const {
+  return Triplet_Format;
+}
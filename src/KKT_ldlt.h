@@ -0,0 +1,81 @@
+#ifndef KKT_LDLT_H
+#define KKT_LDLT_H
+
+#include <string>
+#include <vector>
+#include <coin/IpSparseSymLinearSolverInterface.hpp>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/SparseCholesky"
+#include "Eigen-3.3/Eigen/SparseCore"
+
+// Linear solver of the Newton steps of Ipopt, the sparse LDLT of Eigen in
+// place of the MUMPS of the Ipopt build.
+//
+// The KKT matrix of the MPC keeps its sparsity pattern from one iteration
+// and one solve to the next. The fill-reducing ordering (AMD) and the
+// elimination tree are computed for the first pattern; later calls only
+// scatter the values of Ipopt into the analyzed matrix and redo the numeric
+// factorization. There is no pivoting: a zero pivot is reported as a
+// singular matrix, and Ipopt regularizes the matrix until it is
+// quasi-definite, which any ordering factorizes. The inertia comes from the
+// signs of D.
+class KKT_ldlt : public Ipopt::SparseSymLinearSolverInterface {
+ public:
+  KKT_ldlt();
+
+  bool InitializeImpl(const Ipopt::OptionsList& options,
+                      const std::string& prefix);
+
+  // Pattern of the matrix, 1-based triplets of either triangle. Ipopt
+  // passes it at the start of every optimization, the analysis is only
+  // redone when it differs from the last one.
+  Ipopt::ESymSolverStatus InitializeStructure(Ipopt::Index dim,
+                                              Ipopt::Index nonzeros,
+                                              const Ipopt::Index* ia,
+                                              const Ipopt::Index* ja);
+
+  // Values of the triplets, written by Ipopt before a new matrix is solved.
+  double* GetValuesArrayPtr();
+
+  // Solve for the `nrhs` right hand sides in `rhs_vals` in place,
+  // factorizing the values first if `new_matrix`.
+  Ipopt::ESymSolverStatus MultiSolve(bool new_matrix, const Ipopt::Index* ia,
+                                     const Ipopt::Index* ja,
+                                     Ipopt::Index nrhs, double* rhs_vals,
+                                     bool check_NegEVals,
+                                     Ipopt::Index numberOfNegEVals);
+
+  Ipopt::Index NumberOfNegEVals() const;
+
+  // without pivoting there is nothing to tighten
+  bool IncreaseQuality();
+
+  bool ProvidesInertia() const;
+
+  EMatrixFormat MatrixFormat() const;
+
+  // number of symbolic analyses and numeric factorizations, for benchmarking
+  int analyses;
+  int factorizations;
+
+ private:
+  typedef Eigen::SparseMatrix<double> SparseMatrix;
+
+  // Numeric factorization of the current values.
+  Ipopt::ESymSolverStatus Factor();
+
+  // pattern of the last analysis
+  std::vector<Ipopt::Index> rows;
+  std::vector<Ipopt::Index> cols;
+  // values of the triplets and their position in the lower triangle of
+  // `matrix`, duplicates are summed
+  std::vector<double> values;
+  std::vector<int> position;
+  SparseMatrix matrix;
+  Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower> ldlt;
+  bool factored;
+  // negative eigenvalues of the factorized matrix
+  Ipopt::Index negative;
+};
+
+#endif /* KKT_LDLT_H */
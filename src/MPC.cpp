@@ -1,8 +1,26 @@
 #include "MPC.h"
 #include <cppad/cppad.hpp>
-#include <cppad/ipopt/solve.hpp>
+#include <coin/IpIpoptApplication.hpp>
+#include <coin/IpStdAugSystemSolver.hpp>
+#include <coin/IpTSymLinearSolver.hpp>
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/LU"
+#include "FG_analytic.h"
+#include "FG_eval.h"
+#include "FG_generated.h"
+#include "FG_tape.h"
+#include "ILQR.h"
+#include "KKT_ldlt.h"
+#include "MPC_model.h"
+#include "MPPI.h"
+#include "QP_admm.h"
+#include "QP_box.h"
+#include "QP_riccati.h"
+#include "Pure_pursuit.h"
 
 using CppAD::AD;
 using namespace std;
@@ -17,314 +35,512 @@ using namespace std;
 #define Debug(x)
 #endif
 
-// TODO: Set the timestep length and duration
-/*Tuning process:
- * 1. [Setting] T = N * dt = 1 s, and set dt = 0.1s = 100 ms (same as latency), then N = T / dt = 10.
- *    [Result]: very good. but to view the effects, I change the settings for more fun
- * 2. [Setting] T = N * dt = 2 s, and set dt = 0.1s = 100 ms (same as latency), then N = T / dt = 20.
- *    [Result]: becomes worse at sharp turns (less margin, nearly hit the sidewalk).
- *            Moreover, trajectories predicted by MPC can not fit the desired trajectory at sharp turns.
- *    [Analysis]: the kinematic model is not real dynamic model of vehicles. It cannot model the vehicles very well
- *            at sharp turns. Hence we should not predict a long time. Here, T = 1s is better than T = 2s.
- * 3. [Setting] T = N * dt = 1 s, and set dt = 0.051s = 50 ms, then N = T / dt = 20.
- *    [Result]: the result is very bad. the vehicle is even not stable, like a drunk driver. Finally, the vehicle
- *            run out of the lane at the first sharp turn.
- *    [Analysis]: I cannot figure out the reason. From the lessons, the prediction should be more precise with
- *            smaller dt. I just doubt that the dt = 50 ms not equal to latency 100ms.To verify it, I can try
- *            1) set N = 10, dt = 0.05. If the result is very good, then it is not related to latency time.
- *            2) revise the latency to 50ms
- * 4. [Setting] T = N * dt = 0.5 s, and set dt = 0.05s = 50 ms, then N = T / dt = 10.
- *    [Result]: the result is a little bit better than the previous one. It can stay within the lane but
- *            the angle changes too fast, still like a drunk driver.
- * 5. [Setting] T = N * dt = 1 s, and set dt = 0.05s = 50 ms, then N = T / dt = 20. latency = 50ms
- *    [Result]: the result become better. But the vehicle become unstable at sharp turns and finally runs out of lane.
- * 6. [Setting] T = N * dt = 0.5 s, and set dt = 0.05s = 50 ms, then N = T / dt = 10. latency = 50ms
- *    [Result]: the result is very good. similar to the first setting with latency = 100ms.
- *    [Analysis]: Based on the above few experiments, I conclude that dt should be set the same as latency time.
- *            This would be helpful to deal with the problem brought by latency.
- *    */
-size_t N = 10;
-double dt = 0.1;
-
-// This value assumes the model presented in the classroom is used.
-//
-// It was obtained by measuring the radius formed by running the vehicle in the
-// simulator around in a circle with a constant steering angle and velocity on a
-// flat terrain.
-//
-// Lf was tuned until the the radius formed by the simulating the model
-// presented in the classroom matched the previous radius.
-//
-// This is the length from front to CoG that has a similar radius.
-const double Lf = 2.67;
-
-// Both the reference cross track and orientation errors are 0.
-// The reference velocity is set to 40 mph.
-double ref_v = 70;
-
-// The solver takes all the state variables and actuator
-// variables in a singular vector. Thus, we should to establish
-// when one variable starts and another ends to make our lifes easier.
-size_t x_start = 0;
-size_t y_start = x_start + N;
-size_t psi_start = y_start + N;
-size_t v_start = psi_start + N;
-size_t cte_start = v_start + N;
-size_t epsi_start = cte_start + N;
-size_t delta_start = epsi_start + N;
-size_t a_start = delta_start + N - 1;
-
-class FG_eval {
- public:
-  // Fitted polynomial coefficients
-  Eigen::VectorXd coeffs;
-  FG_eval(Eigen::VectorXd coeffs) { this->coeffs = coeffs; }
-
-  typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
-  // `fg` is a vector containing the cost and constraints.
-  // `vars` is a vector containing the variable values (state & actuators).
-  void operator()(ADvector& fg, const ADvector& vars) {
-    // TODO: implement MPC
-    // `fg` a vector of the cost constraints, `vars` is a vector of variable values (state & actuators)
-    // NOTE: You'll probably go back and forth between this function and
-    // the Solver function below.
-
-    // The cost is stored is the first element of `fg`.
-    // Any additions to the cost should be added to `fg[0]`.
-    fg[0] = 0;
-
-    //define weights for cost functions
-    //tuning these weights
-    //1. the cte and orientation error is the most important, hence we set them to 1000
-    //1.1 the above values are increased to 2000 to avoid abnormal MPC prediction in sharp turn
-    //2. the steering should not be changed so sharp and the jerk should not be large,
-    // considering safety and comfort of passengers, hence they are  set to 100
-    //3. we want limit the steering angle and acceleration, whose weights are set to 10
-    //4. the constant velocity is the least important, hence we just set it to 1
-    const double weight_cte = 2000.0;  //weight for cross track error
-    const double weight_epsi = 2000.0;  //weight for orientation error
-    const double weight_v = 1.0;  //weight for velocity
-    const double weight_delta = 10.0;  //weight for steering angle
-    const double weight_a = 10.0;  //weight for acceleration
-    const double weight_delta_diff = 100.0;  //weight for delta differentiate
-    const double weight_a_diff = 100.0;  //weight for jerk
-
-    // The part of the cost based on the reference state.
-    for (unsigned int t = 0; t < N; t++) {
-      fg[0] += weight_cte * CppAD::pow(vars[cte_start + t], 2);
-      fg[0] += weight_epsi * CppAD::pow(vars[epsi_start + t], 2);
-      fg[0] += weight_v * CppAD::pow(vars[v_start + t] - ref_v, 2);
-    }
-
-    // Minimize the use of actuators.
-    for (unsigned int t = 0; t < N - 1; t++) {
-      fg[0] += weight_delta * CppAD::pow(vars[delta_start + t], 2);
-      fg[0] += weight_a * CppAD::pow(vars[a_start + t], 2);
-    }
-
-    // Minimize the value gap between sequential actuations.
-    for (unsigned int t = 0; t < N - 2; t++) {
-      fg[0] += weight_delta_diff * CppAD::pow(vars[delta_start + t + 1] - vars[delta_start + t], 2);
-      fg[0] += weight_a_diff * CppAD::pow(vars[a_start + t + 1] - vars[a_start + t], 2);
-    }
-
-    //
-    // Setup Constraints
-    //
-    // NOTE: In this section you'll setup the model constraints.
-
-    // Initial constraints
-    //
-    // We add 1 to each of the starting indices due to cost being located at
-    // index 0 of `fg`.
-    // This bumps up the position of all the other values.
-    fg[1 + x_start] = vars[x_start];
-    fg[1 + y_start] = vars[y_start];
-    fg[1 + psi_start] = vars[psi_start];
-    fg[1 + v_start] = vars[v_start];
-    fg[1 + cte_start] = vars[cte_start];
-    fg[1 + epsi_start] = vars[epsi_start];
-
-    // The rest of the constraints
-    for (unsigned int t = 1; t < N; t++) {
-      // The state at time t+1 .
-      AD<double> x1 = vars[x_start + t];
-      AD<double> y1 = vars[y_start + t];
-      AD<double> psi1 = vars[psi_start + t];
-      AD<double> v1 = vars[v_start + t];
-      AD<double> cte1 = vars[cte_start + t];
-      AD<double> epsi1 = vars[epsi_start + t];
-
-      // The state at time t.
-      AD<double> x0 = vars[x_start + t - 1];
-      AD<double> y0 = vars[y_start + t - 1];
-      AD<double> psi0 = vars[psi_start + t - 1];
-      AD<double> v0 = vars[v_start + t - 1];
-      AD<double> cte0 = vars[cte_start + t - 1];
-      AD<double> epsi0 = vars[epsi_start + t - 1];
-
-      // Only consider the actuation at time t.
-      AD<double> delta0 = vars[delta_start + t - 1];
-      AD<double> a0 = vars[a_start + t - 1];
-
-      // note that we are using the 3rd order polynomial now.
-      // f = k0 + k1*x + k2*x^2 + k3*x^3
-      // psi_des = atan (f') = atan (k1 + 2*k2*x + 3*k3*x^2)
-      AD<double> f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] * pow(x0, 2) + coeffs[3] * pow(x0, 3);
-      AD<double> psides0 = CppAD::atan(coeffs[1] + 2 * coeffs[2] * x0 + 3 * coeffs[3] * pow(x0, 2));
-
-      // Here's `x` to get you started.
-      // The idea here is to constraint this value to be 0.
-      //
-      // Recall the equations for the model:
-      // x_[t+1] = x[t] + v[t] * cos(psi[t]) * dt
-      // y_[t+1] = y[t] + v[t] * sin(psi[t]) * dt
-      // psi_[t+1] = psi[t] + v[t] / Lf * delta[t] * dt
-      // v_[t+1] = v[t] + a[t] * dt
-      // cte[t+1] = f(x[t]) - y[t] + v[t] * sin(epsi[t]) * dt
-      // epsi[t+1] = psi[t] - psides[t] + v[t] * delta[t] / Lf * dt
-
-      //Note if delta is positive we rotate counter-clockwise, or turn left.
-      // In the simulator however, a positive value implies a right turn and
-      // a negative value implies a left turn. This is why we update the (delta0)
-      // as (-delta0) in the following equations
-      fg[1 + x_start + t] = x1 - (x0 + v0 * CppAD::cos(psi0) * dt);
-      fg[1 + y_start + t] = y1 - (y0 + v0 * CppAD::sin(psi0) * dt);
-      fg[1 + psi_start + t] = psi1 - (psi0 + v0 * (-delta0) / Lf * dt);
-      fg[1 + v_start + t] = v1 - (v0 + a0 * dt);
-      fg[1 + cte_start + t] =
-              cte1 - ((f0 - y0) + (v0 * CppAD::sin(epsi0) * dt));
-      fg[1 + epsi_start + t] =
-              epsi1 - ((psi0 - psides0) + v0 * (-delta0) / Lf * dt);
-    }
-
-  }
-};
+// The timestep length and duration N and dt are in MPC_model.h, they are
+// the defaults of MPC_config.
+MPC_config::MPC_config() {
+  N = ::N;
+  dt = ::dt;
+  // Both the reference cross track and orientation errors are 0.
+  // The reference velocity is set to 40 mph.
+  ref_v = 70;
+  threads = 0;
+  layout = MPC_layout::VARIABLE_MAJOR;
+  linear_solver = MUMPS;
+  hessian = EXACT;
+}
+
+//the number of states x, y, psi, v, cte, epsi
+const size_t n_state = 6;
+//the number of control inputs delta (steering angle) and a (acceleration)
+const size_t n_actuator = 2;
+
+// The tape of FG_eval has the coefficients of the fitted 3rd order
+// polynomial followed by the reference velocity as dynamic parameters.
+const size_t n_coeffs = 4;
+const size_t n_params = n_coeffs + 1;
+
+// CppAD keeps the recording tape and the memory pools per thread, indexed
+// by the thread number below. A thread gets the next number the first time
+// CppAD asks for it. Numbers are not reused, so at most
+// CPPAD_MAX_NUM_THREADS threads may ever use MPC objects in a process; a
+// thread pool stays within that.
+static atomic<bool> cppad_parallel(false);
+static atomic<size_t> cppad_threads(0);
+
+static bool InParallel() { return cppad_parallel; }
+
+static size_t ThreadNumber() {
+  static thread_local size_t number = cppad_threads++;
+  return number;
+}
+
+// Switch CppAD to multithreaded use before the first tape is recorded. The
+// thread doing it is number 0, as CppAD requires for sequential mode.
+static void ParallelSetup() {
+  static once_flag once;
+  call_once(once, []() {
+    ThreadNumber();
+    CppAD::thread_alloc::parallel_setup(CPPAD_MAX_NUM_THREADS, InParallel,
+                                        ThreadNumber);
+    CppAD::thread_alloc::hold_memory(true);
+    CppAD::parallel_ad<double>();
+    cppad_parallel = true;
+  });
+}
+
+// Ipopt solves of all MPC objects take turns, see MPC.h.
+static mutex ipopt_mutex;
+
+// Record FG_eval once. Only the values of the dynamic parameters change
+// from one solve to the next, so the tape, its sparsity patterns and
+// colorings are reused by every call of Solve.
+static FG_backend* RecordTape(const MPC_layout& layout,
+                              const vector<double>& dt, double ref_v,
+                              const MPC_integrator& integrator) {
+  typedef FG_tape::ADvector ADvector;
+  size_t n_vars = layout.n_vars;
+  size_t n_constraints = layout.n_constraints;
+
+  ADvector vars(n_vars);
+  for (unsigned int i = 0; i < n_vars; i++) {
+    vars[i] = 0;
+  }
+  ADvector params(n_params);
+  for (unsigned int i = 0; i < n_coeffs; i++) {
+    params[i] = 0;
+  }
+  params[n_coeffs] = ref_v;
+  CppAD::Independent(vars, 0, false, params);
+
+  ADvector coeffs(n_coeffs);
+  for (unsigned int i = 0; i < n_coeffs; i++) {
+    coeffs[i] = params[i];
+  }
+  FG_eval<ADvector> fg_eval(layout, dt, coeffs, params[n_coeffs],
+                            integrator);
+  ADvector fg(1 + n_constraints);
+  fg_eval(fg, vars);
+
+  return new FG_tape(vars, fg);
+}
 
 //
 // MPC class definition implementation.
 //
-MPC::MPC() {}
-MPC::~MPC() {}
+static MPC_config WithHorizon(size_t horizon) {
+  MPC_config config;
+  config.N = horizon;
+  return config;
+}
 
-vector<double> MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs) {
-  bool ok = true;
-  //size_t i;
-  typedef CPPAD_TESTVECTOR(double) Dvector;
+// Lengths of the steps of the horizon of `config`.
+static vector<double> Steps(const MPC_config& config) {
+  if (!config.steps.empty()) {
+    return config.steps;
+  }
+  assert(config.N >= 2);
+  return vector<double>(config.N - 1, config.dt);
+}
 
-  double x = state[0];
-  double y = state[1];
-  double psi = state[2];
-  double v = state[3];
-  double cte = state[4];
-  double epsi = state[5];
+MPC::MPC(Derivatives derivatives, size_t horizon)
+    : MPC(WithHorizon(horizon), derivatives) {}
 
-  // TODO: Set the number of model variables (includes both states and inputs).
+MPC::MPC(const MPC_config& config, Derivatives derivatives)
+    : dt(Steps(config)),
+      integrator(config.integrator),
+      layout(dt.size() + 1, config.layout, config.blocks) {
+  N = layout.N;
+  ref_v = config.ref_v;
+  threads = config.threads;
+  ParallelSetup();
+
+  // The solver takes all the state variables and actuator
+  // variables in a singular vector. The layout tells where each one is.
+  //
+  // The number of model variables (includes both states and inputs).
   // For example: If the state is a 4 element vector, the actuators is a 2
   // element vector and there are 10 timesteps. The number of variables is:
   //
   // 4 * 10 + 2 * 9
-  //the number of states x, y, psi, v, cte, epsi
-  const int n_state = 6;
-  //the number of control inputs delta (steering angle) and a (acceleration)
-  const int n_actuator = 2;
-  size_t n_vars = n_state * N + n_actuator * (N-1);
-  // TODO: Set the number of constraints
-  size_t n_constraints = n_state * N;
-
-  // Initial value of the independent variables.
-  // SHOULD BE 0 besides initial state.
-  Dvector vars(n_vars);
-  for (unsigned int i = 0; i < n_vars; i++) {
-    vars[i] = 0;
+  n_vars = layout.n_vars;
+  n_constraints = layout.n_constraints;
+
+  // the generated kernels are only available for the horizon, step and
+  // layout of MPC_model.h, other problems record the tape; both they and
+  // the analytic derivatives are of the single Euler step
+  if (derivatives == GENERATED && dt == vector<double>(::N - 1, ::dt) &&
+      layout.order == MPC_layout::VARIABLE_MAJOR && !layout.Blocked() &&
+      integrator.Euler()) {
+    nlp = new MPC_NLP(new FG_generated());
+  } else if (derivatives == ANALYTIC && integrator.Euler()) {
+    nlp = new MPC_NLP(new FG_analytic(layout, dt));
+  } else {
+    nlp = new MPC_NLP(RecordTape(layout, dt, ref_v, integrator));
   }
-  // Set the initial variable values
-  vars[x_start] = x;
-  vars[y_start] = y;
-  vars[psi_start] = psi;
-  vars[v_start] = v;
-  vars[cte_start] = cte;
-  vars[epsi_start] = epsi;
-
-  // Lower and upper limits for x
-  Dvector vars_lowerbound(n_vars);
-  Dvector vars_upperbound(n_vars);
+
+  nlp->gauss_newton = config.hessian == MPC_config::GAUSS_NEWTON;
+
+  // The bounds below do not change between solves, so they are written
+  // once into the problem. Solve only updates the initial state entries.
+  //
   // TODO: Set lower and upper limits for variables.
   // Set all non-actuators upper and lower limits
   // to the max negative and positive values.
-  for (unsigned int i = 0; i < delta_start; i++) {
-    vars_lowerbound[i] = -1.0e19;
-    vars_upperbound[i] = 1.0e19;
+  for (unsigned int i = 0; i < n_vars; i++) {
+    nlp->vars_lowerbound[i] = -1.0e19;
+    nlp->vars_upperbound[i] = 1.0e19;
   }
 
-  // The upper and lower limits of delta are set to -25 and 25
-  // degrees (values in radians).
-  // NOTE: Feel free to change this to something else.
-  for (unsigned int i = delta_start; i < a_start; i++) {
-    vars_lowerbound[i] = -0.436332;
-    vars_upperbound[i] = 0.436332;
-  }
+  for (unsigned int t = 0; t < N - 1; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    // The upper and lower limits of delta are set to -25 and 25
+    // degrees (values in radians).
+    // NOTE: Feel free to change this to something else.
+    nlp->vars_lowerbound[s.delta] = -delta_max;
+    nlp->vars_upperbound[s.delta] = delta_max;
 
-  // Acceleration/decceleration upper and lower limits.
-  // NOTE: Feel free to change this to something else.
-  for (unsigned int i = a_start; i < n_vars; i++) {
-    vars_lowerbound[i] = -1.0;
-    vars_upperbound[i] = 1.0;
+    // Acceleration/decceleration upper and lower limits.
+    // NOTE: Feel free to change this to something else.
+    nlp->vars_lowerbound[s.a] = -a_max;
+    nlp->vars_upperbound[s.a] = a_max;
   }
 
   // Lower and upper limits for the constraints
   // Should be 0 besides initial state.
-  Dvector constraints_lowerbound(n_constraints);
-  Dvector constraints_upperbound(n_constraints);
   for (unsigned int i = 0; i < n_constraints; i++) {
-    constraints_lowerbound[i] = 0;
-    constraints_upperbound[i] = 0;
-  }
-  constraints_lowerbound[x_start] = x;
-  constraints_lowerbound[y_start] = y;
-  constraints_lowerbound[psi_start] = psi;
-  constraints_lowerbound[v_start] = v;
-  constraints_lowerbound[cte_start] = cte;
-  constraints_lowerbound[epsi_start] = epsi;
-
-  constraints_upperbound[x_start] = x;
-  constraints_upperbound[y_start] = y;
-  constraints_upperbound[psi_start] = psi;
-  constraints_upperbound[v_start] = v;
-  constraints_upperbound[cte_start] = cte;
-  constraints_upperbound[epsi_start] = epsi;
-
-  // object that computes objective and constraints
-  FG_eval fg_eval(coeffs);
+    nlp->constraints_lowerbound[i] = 0;
+    nlp->constraints_upperbound[i] = 0;
+  }
 
   //
   // NOTE: You don't have to worry about these options
   //
-  // options for IPOPT solver
-  std::string options;
+  // The IPOPT application lives as long as the MPC object, so the options
+  // are parsed and its buffers are allocated only once.
+  lock_guard<mutex> lock(ipopt_mutex);
+  app = IpoptApplicationFactory();
   // Uncomment this if you'd like more print information
-  options += "Integer print_level  0\n";
-  // NOTE: Setting sparse to true allows the solver to take advantage
-  // of sparse routines, this makes the computation MUCH FASTER. If you
-  // can uncomment 1 of these and see if it makes a difference or not but
-  // if you uncomment both the computation time should go up in orders of
-  // magnitude.
-  options += "Sparse  true        forward\n";
-  options += "Sparse  true        reverse\n";
-  // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
-  // Change this as you see fit.
-  options += "Numeric max_cpu_time          0.5\n";
-
-  // place to return solution
-  CppAD::ipopt::solve_result<Dvector> solution;
-
-  // solve the problem
-  CppAD::ipopt::solve<Dvector, FG_eval>(
-      options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
-      constraints_upperbound, fg_eval, solution);
+  app->Options()->SetIntegerValue("print_level", 0);
+  // NOTE: There is no CPU time limit, Solve stops the solver at its
+  // wall-clock deadline instead.
+  // A warm start begins close to the optimum, so the initial point should
+  // not be pushed far into the interior.
+  app->Options()->SetNumericValue("warm_start_bound_push", 1e-6);
+  app->Options()->SetNumericValue("warm_start_slack_bound_push", 1e-6);
+  app->Options()->SetNumericValue("warm_start_mult_bound_push", 1e-6);
+  if (config.hessian == MPC_config::LBFGS) {
+    app->Options()->SetStringValue("hessian_approximation", "limited-memory");
+  }
+  app->Initialize();
+  optimized = false;
+
+  // The Eigen solver replaces the one of the options in the augmented
+  // system solver of the algorithm, without scaling like MUMPS. It lives as
+  // long as the application, so its analysis is kept between solves.
+  //
+  // Without pivoting the factorization needs the multiplier block of the
+  // constraints regularized, Ipopt otherwise only does that after a
+  // singular factorization in every solve.
+  if (config.linear_solver == MPC_config::EIGEN_LDLT) {
+    app->Options()->SetStringValue("perturb_always_cd", "yes");
+    Ipopt::SmartPtr<Ipopt::SymLinearSolver> solver =
+        new Ipopt::TSymLinearSolver(new KKT_ldlt(), NULL);
+    builder = new Ipopt::AlgorithmBuilder(
+        new Ipopt::StdAugSystemSolver(*solver));
+  }
+
+  warm_start = true;
+  start = SHIFTED;
+  pursuit.reset(new Pure_pursuit(config));
+  optimizer = IPOPT;
+  real_time_iteration = false;
+  frame_valid = false;
+  plan_valid = false;
+  rti.prepared = false;
+}
+
+MPC::~MPC() {
+  // the application is released under the lock as well
+  lock_guard<mutex> lock(ipopt_mutex);
+  adapter = NULL;
+  builder = NULL;
+  app = NULL;
+}
+
+void MPC::SetFrame(double px, double py, double psi) {
+  frame_x = px;
+  frame_y = py;
+  frame_psi = psi;
+  frame_valid = true;
+}
+
+bool MPC::ShiftSolution(const Eigen::VectorXd& coeffs) {
+  const MPC_NLP::Solution& solution = nlp->solution;
+  if (!plan_valid || !frame_valid || solution.status != Ipopt::SUCCESS) {
+    return false;
+  }
+
+  // Everything moves one step ahead: stage t starts from stage t + 1 of the
+  // last solution, the last stage is extrapolated below and the last
+  // actuation is held. A move block starts from the actuation one step
+  // after its first step. With steps of different lengths the stages are
+  // shifted all the same, only a starting point is needed.
+  for (unsigned int t = 0; t < N; t++) {
+    unsigned int src = min(t + 1, (unsigned int)N - 1);
+    for (unsigned int i = 0; i < n_state; i++) {
+      size_t to = layout.State(i, t);
+      size_t from = layout.State(i, src);
+      nlp->vars[to] = solution.x[from];
+      nlp->z_L[to] = solution.z_L[from];
+      nlp->z_U[to] = solution.z_U[from];
+      nlp->lambda[layout.Row(i, t)] = solution.lambda[layout.Row(i, src)];
+    }
+  }
+  for (unsigned int b = 0; b < layout.n_blocks; b++) {
+    unsigned int t = layout.block_start[b];
+    unsigned int src = min(t + 1, (unsigned int)N - 2);
+    for (unsigned int j = 0; j < n_actuator; j++) {
+      size_t to = layout.Actuator(j, t);
+      size_t from = layout.Actuator(j, src);
+      nlp->vars[to] = solution.x[from];
+      nlp->z_L[to] = solution.z_L[from];
+      nlp->z_U[to] = solution.z_U[from];
+    }
+  }
+
+  // main.cpp expresses everything relative to the vehicle each tick, so the
+  // positions and headings are moved from the frame of the last solve to the
+  // new one. cte and epsi are relative to the path and stay as they are.
+  double dx = plan_x - frame_x;
+  double dy = plan_y - frame_y;
+  double ox = dx * cos(frame_psi) + dy * sin(frame_psi);
+  double oy = -dx * sin(frame_psi) + dy * cos(frame_psi);
+  double dpsi = plan_psi - frame_psi;
+  for (unsigned int t = 0; t < N; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    double px = nlp->vars[s.x];
+    double py = nlp->vars[s.y];
+    nlp->vars[s.x] = ox + px * cos(dpsi) - py * sin(dpsi);
+    nlp->vars[s.y] = oy + px * sin(dpsi) + py * cos(dpsi);
+    nlp->vars[s.psi] += dpsi;
+  }
+
+  // extrapolate the last stage with the model and the held actuation
+  MPC_layout::Stage s0 = layout.Vars(N - 2);
+  MPC_layout::Stage s1 = layout.Vars(N - 1);
+  double x0 = nlp->vars[s0.x];
+  double y0 = nlp->vars[s0.y];
+  double psi0 = nlp->vars[s0.psi];
+  double v0 = nlp->vars[s0.v];
+  double epsi0 = nlp->vars[s0.epsi];
+  double delta0 = nlp->vars[s0.delta];
+  double a0 = nlp->vars[s0.a];
+  double f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] * pow(x0, 2) + coeffs[3] * pow(x0, 3);
+  double psides0 = atan(coeffs[1] + 2 * coeffs[2] * x0 + 3 * coeffs[3] * pow(x0, 2));
+  double dt = this->dt[N - 2];
+  if (integrator.Euler()) {
+    nlp->vars[s1.x] = x0 + v0 * cos(psi0) * dt;
+    nlp->vars[s1.y] = y0 + v0 * sin(psi0) * dt;
+    nlp->vars[s1.psi] = psi0 + v0 * (-delta0) / Lf * dt;
+    nlp->vars[s1.v] = v0 + a0 * dt;
+    nlp->vars[s1.cte] = (f0 - y0) + v0 * sin(epsi0) * dt;
+    nlp->vars[s1.epsi] = (psi0 - psides0) + v0 * (-delta0) / Lf * dt;
+    return true;
+  }
+  double z[6] = {x0, y0, psi0, v0, f0 - y0, psi0 - psides0};
+  integrator.Step(z, delta0, a0, dt);
+  nlp->vars[s1.x] = z[0];
+  nlp->vars[s1.y] = z[1];
+  nlp->vars[s1.psi] = z[2];
+  nlp->vars[s1.v] = z[3];
+  nlp->vars[s1.cte] = z[4];
+  nlp->vars[s1.epsi] = z[5];
+  return true;
+}
+
+void MPC::Rollout(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs) {
+  // steering angle of the path curvature under the vehicle, negated for the
+  // simulator
+  double x0 = state[0];
+  double d1 = coeffs[1] + x0 * (2 * coeffs[2] + 3 * coeffs[3] * x0);
+  double d2 = 2 * coeffs[2] + 6 * coeffs[3] * x0;
+  double arc = -Lf * d2 / pow(1 + d1 * d1, 1.5);
+  arc = max(-delta_max, min(delta_max, arc));
+
+  Eigen::VectorXd z = state;
+  for (unsigned int t = 0; t < N; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    nlp->vars[s.x] = z[0];
+    nlp->vars[s.y] = z[1];
+    nlp->vars[s.psi] = z[2];
+    nlp->vars[s.v] = z[3];
+    nlp->vars[s.cte] = z[4];
+    nlp->vars[s.epsi] = z[5];
+    if (t == N - 1) {
+      break;
+    }
+    double delta = arc;
+    double a = 0.0;
+    if (start == PURSUIT) {
+      pursuit->Actuation(z, coeffs, delta, a);
+    }
+    // a move block takes the actuation of its first step
+    if (t == 0 || layout.Vars(t).delta != layout.Vars(t - 1).delta) {
+      nlp->vars[s.delta] = delta;
+      nlp->vars[s.a] = a;
+    }
+    delta = nlp->vars[s.delta];
+    a = nlp->vars[s.a];
+
+    // cte and epsi of the next stage start from the path, as in FG_eval
+    double x = z[0];
+    double f = coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3]));
+    double psides = atan(coeffs[1] + x * (2 * coeffs[2] + 3 * coeffs[3] * x));
+    double next[6] = {x, z[1], z[2], z[3], f - z[1], z[2] - psides};
+    integrator.Step(next, delta, a, dt[t]);
+    for (int i = 0; i < 6; i++) {
+      z[i] = next[i];
+    }
+  }
+}
+
+void MPC::CopySolution(const MPC& other) {
+  nlp->solution = other.nlp->solution;
+  plan_x = other.plan_x;
+  plan_y = other.plan_y;
+  plan_psi = other.plan_psi;
+  plan_valid = other.plan_valid;
+}
+
+MPC_result MPC::Plan(const Eigen::VectorXd& state,
+                     const Eigen::VectorXd& coeffs,
+                     chrono::steady_clock::time_point deadline) {
+  if (real_time_iteration) {
+    return Feedback(state, coeffs, deadline);
+  }
+  return Optimize(state, coeffs, deadline);
+}
+
+MPC_result MPC::Optimize(const Eigen::VectorXd& state,
+                         const Eigen::VectorXd& coeffs,
+                         chrono::steady_clock::time_point deadline) {
+  //size_t i;
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+
+  double x = state[0];
+  double y = state[1];
+  double psi = state[2];
+  double v = state[3];
+  double cte = state[4];
+  double epsi = state[5];
+
+  // Update the parameters of the cost and constraints.
+  Dvector params(n_params);
+  for (unsigned int i = 0; i < n_coeffs; i++) {
+    params[i] = coeffs[i];
+  }
+  params[n_coeffs] = ref_v;
+  nlp->backend->SetParameters(params.data());
+
+  // Start from the shifted last solution when there is one, otherwise
+  // from zero or the rollout of the start.
+  nlp->warm_start = start == SHIFTED && warm_start && ShiftSolution(coeffs);
+  if (!nlp->warm_start) {
+    for (unsigned int i = 0; i < n_vars; i++) {
+      nlp->vars[i] = 0;
+    }
+    if (start == ARC || start == PURSUIT) {
+      Rollout(state, coeffs);
+    }
+  }
+  app->Options()->SetStringValue("warm_start_init_point",
+                                 nlp->warm_start ? "yes" : "no");
+  app->Options()->SetNumericValue("mu_init", nlp->warm_start ? 1e-4 : 0.1);
+
+  // Set the initial variable values
+  MPC_layout::Stage s = layout.Vars(0);
+  nlp->vars[s.x] = x;
+  nlp->vars[s.y] = y;
+  nlp->vars[s.psi] = psi;
+  nlp->vars[s.v] = v;
+  nlp->vars[s.cte] = cte;
+  nlp->vars[s.epsi] = epsi;
+
+  // The initial state is fixed by the constraints
+  MPC_layout::Stage r = layout.Rows(0);
+  nlp->constraints_lowerbound[r.x] = x;
+  nlp->constraints_lowerbound[r.y] = y;
+  nlp->constraints_lowerbound[r.psi] = psi;
+  nlp->constraints_lowerbound[r.v] = v;
+  nlp->constraints_lowerbound[r.cte] = cte;
+  nlp->constraints_lowerbound[r.epsi] = epsi;
+
+  nlp->constraints_upperbound[r.x] = x;
+  nlp->constraints_upperbound[r.y] = y;
+  nlp->constraints_upperbound[r.psi] = psi;
+  nlp->constraints_upperbound[r.v] = v;
+  nlp->constraints_upperbound[r.cte] = cte;
+  nlp->constraints_upperbound[r.epsi] = epsi;
+
+  nlp->deadline = deadline;
+
+  // the other optimizers need an actuation per step
+  if (layout.Blocked() && optimizer != IPOPT && optimizer != ADMM) {
+    nlp->solution.status = Ipopt::INVALID_OPTION;
+    plan_valid = false;
+    return MPC_result();
+  }
+
+  // solve the problem, the derivatives come from the backend. The
+  // structure never changes, so later solves reuse the application state.
+  if (optimizer == RICCATI) {
+    OptimizeRiccati();
+  } else if (optimizer == ADMM) {
+    OptimizeADMM();
+  } else if (optimizer == ILQR) {
+    OptimizeILQR(params.data());
+  } else if (optimizer == MPPI) {
+    OptimizeMPPI(params.data());
+  } else if (optimized) {
+    lock_guard<mutex> lock(ipopt_mutex);
+    if (IsValid(adapter)) {
+      app->ReOptimizeNLP(adapter);
+    } else {
+      app->ReOptimizeTNLP(nlp);
+    }
+  } else {
+    lock_guard<mutex> lock(ipopt_mutex);
+    if (IsValid(builder)) {
+      adapter = new Ipopt::TNLPAdapter(GetRawPtr(nlp), app->Jnlst());
+      app->OptimizeNLP(adapter, builder);
+    } else {
+      app->OptimizeTNLP(nlp);
+    }
+    optimized = true;
+  }
+  const MPC_NLP::Solution& solution = nlp->solution;
+
+  // the next warm start re-projects this solution from the current frame
+  plan_x = frame_x;
+  plan_y = frame_y;
+  plan_psi = frame_psi;
+  plan_valid = frame_valid;
+
+  MPC_result result;
+  result.iterations = solution.iterations;
 
   // Check some of the solution values
-  ok &= solution.status == CppAD::ipopt::solve_result<Dvector>::success;
+  if (solution.status == Ipopt::SUCCESS ||
+      solution.status == Ipopt::STOP_AT_ACCEPTABLE_POINT) {
+    result.status = MPC_result::CONVERGED;
+  } else if (solution.status == Ipopt::USER_REQUESTED_STOP &&
+             solution.feasible) {
+    result.status = MPC_result::TRUNCATED;
+  } else {
+    result.status = MPC_result::FAILED;
+  }
+  Debug("MPC status " << result.status << ", " << result.iterations
+        << " iterations" << endl);
 
   // Cost
   //auto cost = solution.obj_value;
@@ -342,17 +558,618 @@ vector<double> MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs) {
           solution.x[delta_start],   solution.x[a_start]};
           */
 
-  vector<double> result;
+  if (result.status == MPC_result::FAILED) {
+    return result;
+  }
 
   //store the control signals: steering angle -- delta and acceleration -- a
-  result.push_back(solution.x[delta_start]);
-  result.push_back(solution.x[a_start]);
+  result.delta = solution.x[s.delta];
+  result.a = solution.x[s.a];
 
   //store the predicted trajectory: x and y points, which we need to plot the green line in the simulator
   for (unsigned int i = 0; i < N; i++) {
-    result.push_back(solution.x[x_start + i]);
-    result.push_back(solution.x[y_start + i]);
+    result.x.push_back(solution.x[layout.State(MPC_layout::X, i)]);
+    result.y.push_back(solution.x[layout.State(MPC_layout::Y, i)]);
   }
 
   return result;
 }
+
+// Sequential quadratic programming on the stage structure of the problem.
+// Every iteration linearizes the model constraints at the current trajectory
+// and solves the QP of the full step with the Riccati interior-point method.
+// The cost is quadratic, so its Hessian is the exact Gauss-Newton Hessian.
+// The stage state is augmented with the previous actuation, which turns the
+// rate penalties into stage costs.
+void MPC::OptimizeRiccati() {
+  const int n_aug = n_state + n_actuator;
+  typedef QP_riccati<n_aug, n_actuator> QP;
+  const int max_iterations = 30;
+  FG_backend& backend = *nlp->backend;
+  size_t M = N - 1;
+
+  Eigen::VectorXd w(n_vars);
+  for (unsigned int i = 0; i < n_vars; i++) {
+    w[i] = nlp->vars[i];
+  }
+
+  vector<int> jac_rows(backend.JacNonzeros());
+  vector<int> jac_cols(backend.JacNonzeros());
+  vector<double> jac(backend.JacNonzeros());
+  backend.JacStructure(jac_rows.data(), jac_cols.data());
+  vector<int> hes_rows(backend.HesNonzeros());
+  vector<int> hes_cols(backend.HesNonzeros());
+  vector<double> hes(backend.HesNonzeros());
+  backend.HesStructure(hes_rows.data(), hes_cols.data());
+
+  // the Hessian of the cost is constant, it is placed into the stages once
+  QP qp(N);
+  for (size_t t = 0; t < N; t++) {
+    qp.stages[t].Q.setZero();
+    qp.stages[t].S.setZero();
+    qp.stages[t].R.setZero();
+  }
+  vector<double> lambda(n_constraints, 0.0);
+  backend.EvalH(w.data(), true, 1.0, lambda.data(), hes.data());
+  bool staged = true;
+  for (size_t k = 0; k < hes.size(); k++) {
+    size_t s_row, s_col, i_row, i_col;
+    bool u_row = layout.Locate(hes_rows[k], s_row, i_row);
+    bool u_col = layout.Locate(hes_cols[k], s_col, i_col);
+    bool diagonal = hes_rows[k] == hes_cols[k];
+    if (!u_row && !u_col && s_row == s_col) {
+      qp.stages[s_row].Q(i_row, i_col) += hes[k];
+      if (!diagonal) {
+        qp.stages[s_row].Q(i_col, i_row) += hes[k];
+      }
+    } else if (u_row && u_col && s_row == s_col) {
+      qp.stages[s_row].R(i_row, i_col) += hes[k];
+      if (!diagonal) {
+        qp.stages[s_row].R(i_col, i_row) += hes[k];
+      }
+    } else if (u_row && u_col && s_row == s_col + 1) {
+      // the previous actuation is part of the augmented state
+      qp.stages[s_row].S(i_row, n_state + i_col) += hes[k];
+    } else if (u_row && u_col && s_col == s_row + 1) {
+      qp.stages[s_col].S(i_col, n_state + i_row) += hes[k];
+    } else if (u_row && !u_col && s_row == s_col) {
+      qp.stages[s_row].S(i_row, i_col) += hes[k];
+    } else if (!u_row && u_col && s_row == s_col) {
+      qp.stages[s_col].S(i_col, i_row) += hes[k];
+    } else {
+      staged = false;
+    }
+  }
+
+  Ipopt::SolverReturn status = Ipopt::MAXITER_EXCEEDED;
+  int iteration = 0;
+  Eigen::VectorXd g(n_constraints);
+  Eigen::VectorXd grad(n_vars);
+  while (staged && iteration < max_iterations) {
+    iteration++;
+    backend.EvalG(w.data(), true, g.data());
+    backend.EvalJacG(w.data(), false, jac.data());
+    backend.EvalGradF(w.data(), false, grad.data());
+
+    // linearized model, the augmented state of stage t + 1 is the
+    // actuation of stage t
+    for (size_t t = 0; t < M; t++) {
+      qp.stages[t].A.setZero();
+      qp.stages[t].B.setZero();
+      qp.stages[t].B.bottomRows(n_actuator).setIdentity();
+      qp.stages[t].d.setZero();
+    }
+    for (size_t k = 0; k < jac.size(); k++) {
+      size_t t, i, s_col, i_col;
+      layout.LocateRow(jac_rows[k], t, i);
+      bool u_col = layout.Locate(jac_cols[k], s_col, i_col);
+      if (t == 0 || (!u_col && s_col == t)) {
+        // initial state rows, and the next state with coefficient 1
+        continue;
+      } else if (s_col + 1 != t) {
+        staged = false;
+      } else if (u_col) {
+        qp.stages[s_col].B(i, i_col) = -jac[k];
+      } else {
+        qp.stages[s_col].A(i, i_col) = -jac[k];
+      }
+    }
+
+    // defects of the model and the distance to the initial state
+    qp.z0.setZero();
+    for (unsigned int i = 0; i < n_state; i++) {
+      size_t row = layout.Row(i, 0);
+      qp.z0[i] = nlp->constraints_lowerbound[row] - g[row];
+      for (size_t t = 1; t < N; t++) {
+        row = layout.Row(i, t);
+        qp.stages[t - 1].d[i] = nlp->constraints_lowerbound[row] - g[row];
+      }
+    }
+
+    // gradient and the bounds of the actuation steps
+    for (size_t t = 0; t < N; t++) {
+      qp.stages[t].q.setZero();
+      for (unsigned int i = 0; i < n_state; i++) {
+        qp.stages[t].q[i] = grad[layout.State(i, t)];
+      }
+      if (t == M) {
+        break;
+      }
+      for (unsigned int j = 0; j < n_actuator; j++) {
+        size_t var = layout.Actuator(j, t);
+        qp.stages[t].r[j] = grad[var];
+        qp.stages[t].lb[j] = nlp->vars_lowerbound[var] - w[var];
+        qp.stages[t].ub[j] = nlp->vars_upperbound[var] - w[var];
+      }
+    }
+
+    if (!staged || qp.Solve() < 0) {
+      status = Ipopt::ERROR_IN_STEP_COMPUTATION;
+      break;
+    }
+
+    // full step
+    double step = 0.0;
+    for (size_t t = 0; t < N; t++) {
+      for (unsigned int i = 0; i < n_state; i++) {
+        w[layout.State(i, t)] += qp.z[t][i];
+        step = max(step, fabs(qp.z[t][i]));
+      }
+    }
+    for (size_t t = 0; t < M; t++) {
+      for (unsigned int j = 0; j < n_actuator; j++) {
+        w[layout.Actuator(j, t)] += qp.u[t][j];
+        step = max(step, fabs(qp.u[t][j]));
+      }
+    }
+    if (step < 1e-6 * (1.0 + w.cwiseAbs().maxCoeff())) {
+      status = Ipopt::SUCCESS;
+      break;
+    }
+    if (nlp->Stopped()) {
+      status = Ipopt::USER_REQUESTED_STOP;
+      break;
+    }
+  }
+  if (!staged) {
+    status = Ipopt::INTERNAL_ERROR;
+  }
+
+  StoreSolution(w, status, iteration);
+}
+
+// Sequential quadratic programming like OptimizeRiccati, but the QP of each
+// step is posed on the variable layout of the problem, with the model
+// constraints and then the actuator bounds of DELTA and of A, one per move
+// block, as rows, and solved with ADMM. The
+// pattern of its KKT matrix is the same in every iteration of every tick,
+// so the symbolic analysis is done once; the numeric factorization is only
+// redone when the linearization or rho changes. The multipliers carry over
+// from one QP to the next and are shifted by one stage between ticks.
+void MPC::OptimizeADMM() {
+  const int max_iterations = 30;
+  FG_backend& backend = *nlp->backend;
+  size_t M = layout.n_blocks;
+  size_t n_bounds = n_actuator * M;
+  size_t n_rows = n_constraints + n_bounds;
+  if (!admm) {
+    admm.reset(new QP_admm());
+  }
+
+  Eigen::VectorXd w(n_vars);
+  for (unsigned int i = 0; i < n_vars; i++) {
+    w[i] = nlp->vars[i];
+  }
+
+  vector<int> jac_rows(backend.JacNonzeros());
+  vector<int> jac_cols(backend.JacNonzeros());
+  vector<double> jac(backend.JacNonzeros());
+  backend.JacStructure(jac_rows.data(), jac_cols.data());
+  vector<int> hes_rows(backend.HesNonzeros());
+  vector<int> hes_cols(backend.HesNonzeros());
+  vector<double> hes(backend.HesNonzeros());
+  backend.HesStructure(hes_rows.data(), hes_cols.data());
+
+  // the Hessian of the cost is constant, both of its triangles
+  vector<double> lambda(n_constraints, 0.0);
+  backend.EvalH(w.data(), true, 1.0, lambda.data(), hes.data());
+  vector<Eigen::Triplet<double> > triplets;
+  for (size_t k = 0; k < hes.size(); k++) {
+    triplets.push_back(
+        Eigen::Triplet<double>(hes_rows[k], hes_cols[k], hes[k]));
+    if (hes_rows[k] != hes_cols[k]) {
+      triplets.push_back(
+          Eigen::Triplet<double>(hes_cols[k], hes_rows[k], hes[k]));
+    }
+  }
+  QP_admm::SparseMatrix P(n_vars, n_vars);
+  P.setFromTriplets(triplets.begin(), triplets.end());
+
+  // multipliers of the last tick, one stage ahead
+  if (nlp->warm_start && (size_t)admm->y.size() == n_rows) {
+    Eigen::VectorXd y = admm->y;
+    for (unsigned int t = 0; t < N; t++) {
+      unsigned int src = min(t + 1, (unsigned int)N - 1);
+      for (unsigned int i = 0; i < n_state; i++) {
+        admm->y[layout.Row(i, t)] = y[layout.Row(i, src)];
+      }
+    }
+    for (unsigned int b = 0; b < M; b++) {
+      // the block of the step after the first one, like ShiftSolution
+      size_t src = layout.block[min(layout.block_start[b] + 1, N - 2)];
+      for (unsigned int j = 0; j < n_actuator; j++) {
+        admm->y[n_constraints + j * M + b] = y[n_constraints + j * M + src];
+      }
+    }
+  } else {
+    admm->y = Eigen::VectorXd::Zero(n_rows);
+  }
+
+  Ipopt::SolverReturn status = Ipopt::MAXITER_EXCEEDED;
+  int iteration = 0;
+  Eigen::VectorXd g(n_constraints);
+  Eigen::VectorXd q(n_vars);
+  Eigen::VectorXd l(n_rows);
+  Eigen::VectorXd u(n_rows);
+  QP_admm::SparseMatrix A(n_rows, n_vars);
+  while (iteration < max_iterations) {
+    iteration++;
+    backend.EvalG(w.data(), true, g.data());
+    backend.EvalJacG(w.data(), false, jac.data());
+    backend.EvalGradF(w.data(), false, q.data());
+
+    // linearized constraints, then the actuators
+    triplets.clear();
+    for (size_t k = 0; k < jac.size(); k++) {
+      triplets.push_back(
+          Eigen::Triplet<double>(jac_rows[k], jac_cols[k], jac[k]));
+    }
+    for (unsigned int i = 0; i < n_bounds; i++) {
+      triplets.push_back(Eigen::Triplet<double>(
+          n_constraints + i,
+          layout.Actuator(i / M, layout.block_start[i % M]), 1.0));
+    }
+    A.setFromTriplets(triplets.begin(), triplets.end());
+    admm->SetMatrices(P, A);
+
+    for (unsigned int i = 0; i < n_constraints; i++) {
+      l[i] = nlp->constraints_lowerbound[i] - g[i];
+      u[i] = nlp->constraints_upperbound[i] - g[i];
+    }
+    for (unsigned int i = 0; i < n_bounds; i++) {
+      size_t var = layout.Actuator(i / M, layout.block_start[i % M]);
+      l[n_constraints + i] = nlp->vars_lowerbound[var] - w[var];
+      u[n_constraints + i] = nlp->vars_upperbound[var] - w[var];
+    }
+
+    admm->x.setZero(n_vars);
+    if (admm->Solve(q, l, u, nlp->deadline) < 0) {
+      status = nlp->Stopped() ? Ipopt::USER_REQUESTED_STOP
+                              : Ipopt::ERROR_IN_STEP_COMPUTATION;
+      break;
+    }
+
+    // full step, the QP is only solved to the accuracy of ADMM
+    w += admm->x;
+    if (admm->x.cwiseAbs().maxCoeff() <
+        1e-4 * (1.0 + w.cwiseAbs().maxCoeff())) {
+      status = Ipopt::SUCCESS;
+      break;
+    }
+    if (nlp->Stopped()) {
+      status = Ipopt::USER_REQUESTED_STOP;
+      break;
+    }
+  }
+
+  StoreSolution(w, status, iteration);
+}
+
+// iLQR only optimizes the actuations, the states are rolled out through the
+// model, so every iterate satisfies the constraints. The actuations of the
+// starting point are the initial guess.
+void MPC::OptimizeILQR(const double* params) {
+  size_t M = N - 1;
+  if (!ilqr) {
+    ilqr.reset(new ::ILQR(N, dt));
+  }
+  ilqr->SetParameters(params);
+  for (unsigned int t = 0; t < M; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    ilqr->u[t] << nlp->vars[s.delta], nlp->vars[s.a];
+  }
+  Eigen::VectorXd x0(n_state);
+  for (unsigned int i = 0; i < n_state; i++) {
+    x0[i] = nlp->constraints_lowerbound[layout.Row(i, 0)];
+  }
+
+  Ipopt::SolverReturn status = Ipopt::SUCCESS;
+  if (ilqr->Solve(x0, [this]() { return nlp->Stopped(); }) < 0) {
+    if (nlp->Stopped()) {
+      status = Ipopt::USER_REQUESTED_STOP;
+    } else if (ilqr->iterations < ilqr->max_iterations) {
+      status = Ipopt::ERROR_IN_STEP_COMPUTATION;
+    } else {
+      status = Ipopt::MAXITER_EXCEEDED;
+    }
+  }
+
+  Eigen::VectorXd w(n_vars);
+  for (unsigned int t = 0; t < N; t++) {
+    for (unsigned int i = 0; i < n_state; i++) {
+      w[layout.State(i, t)] = ilqr->x[t][i];
+    }
+  }
+  for (unsigned int t = 0; t < M; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    w[s.delta] = ilqr->u[t][0];
+    w[s.a] = ilqr->u[t][1];
+  }
+  StoreSolution(w, status, ilqr->iterations);
+}
+
+// MPPI takes a single update from the actuations of the starting point with
+// 2048 samples split over the threads of the config. Its plan is a rollout
+// of the model, so it satisfies the constraints; it is truncated when the
+// deadline cut the updates short.
+void MPC::OptimizeMPPI(const double* params) {
+  size_t M = N - 1;
+  if (!mppi) {
+    int n = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+    mppi.reset(new ::MPPI(N, dt, 2048, n));
+  }
+  mppi->SetParameters(params);
+  for (unsigned int t = 0; t < M; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    mppi->u(t, 0) = nlp->vars[s.delta];
+    mppi->u(t, 1) = nlp->vars[s.a];
+  }
+  Eigen::VectorXd x0(n_state);
+  for (unsigned int i = 0; i < n_state; i++) {
+    x0[i] = nlp->constraints_lowerbound[layout.Row(i, 0)];
+  }
+  int updates = mppi->Solve(x0, nlp->deadline);
+
+  Eigen::VectorXd w(n_vars);
+  for (unsigned int t = 0; t < N; t++) {
+    for (unsigned int i = 0; i < n_state; i++) {
+      w[layout.State(i, t)] = mppi->x(t, i);
+    }
+  }
+  for (unsigned int t = 0; t < M; t++) {
+    MPC_layout::Stage s = layout.Vars(t);
+    w[s.delta] = mppi->u(t, 0);
+    w[s.a] = mppi->u(t, 1);
+  }
+  // cut by the deadline before all updates, the rollout is still feasible
+  Ipopt::SolverReturn status = updates < mppi->iterations
+                                   ? Ipopt::USER_REQUESTED_STOP
+                                   : Ipopt::SUCCESS;
+  StoreSolution(w, status, updates);
+}
+
+void MPC::StoreSolution(const Eigen::VectorXd& w, Ipopt::SolverReturn status,
+                        int iterations) {
+  FG_backend& backend = *nlp->backend;
+  MPC_NLP::Solution& solution = nlp->solution;
+
+  // primal infeasibility of the result
+  Eigen::VectorXd g(n_constraints);
+  backend.EvalG(w.data(), true, g.data());
+  double infeasibility = 0.0;
+  for (unsigned int i = 0; i < n_constraints; i++) {
+    infeasibility = max(infeasibility,
+                        fabs(g[i] - nlp->constraints_lowerbound[i]));
+  }
+
+  // there are no multipliers for a later warm start of Ipopt
+  solution.status = status;
+  for (unsigned int i = 0; i < n_vars; i++) {
+    solution.x[i] = w[i];
+    solution.z_L[i] = 0.0;
+    solution.z_U[i] = 0.0;
+  }
+  for (unsigned int i = 0; i < n_constraints; i++) {
+    solution.lambda[i] = 0.0;
+  }
+  solution.obj_value = backend.EvalF(w.data(), false);
+  solution.iterations = iterations;
+  solution.feasible = infeasibility <= nlp->feasibility_tol;
+}
+
+void MPC::Prepare(const Eigen::VectorXd& coeffs) {
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+  rti.prepared = false;
+  if (!real_time_iteration) {
+    return;
+  }
+
+  // linearization point: the last trajectory shifted into the current frame;
+  // the condensing needs an actuation per step
+  if (layout.Blocked() || !ShiftSolution(coeffs)) {
+    return;
+  }
+  FG_backend& backend = *nlp->backend;
+  Dvector params(n_params);
+  for (unsigned int i = 0; i < n_coeffs; i++) {
+    params[i] = coeffs[i];
+  }
+  params[n_coeffs] = ref_v;
+  backend.SetParameters(params.data());
+
+  Eigen::VectorXd w(n_vars);
+  for (unsigned int i = 0; i < n_vars; i++) {
+    w[i] = nlp->vars[i];
+  }
+
+  // The condensing below works on the variable-major layout, the variables
+  // and constraint rows of the problem are permuted into it.
+  MPC_layout canonical(N);
+  rti.index.resize(n_vars);
+  for (size_t var = 0; var < n_vars; var++) {
+    size_t t, i;
+    rti.index[var] = layout.Locate(var, t, i) ? canonical.Actuator(i, t)
+                                              : canonical.State(i, t);
+  }
+  vector<size_t> row_index(n_constraints);
+  for (size_t row = 0; row < n_constraints; row++) {
+    size_t t, i;
+    layout.LocateRow(row, t, i);
+    row_index[row] = canonical.Row(i, t);
+  }
+
+  // defects and Jacobian of the model constraints
+  Eigen::VectorXd value(max(n_vars, n_constraints));
+  Eigen::VectorXd g(n_constraints);
+  backend.EvalG(w.data(), true, value.data());
+  for (size_t row = 0; row < n_constraints; row++) {
+    g[row_index[row]] = value[row];
+  }
+  vector<int> rows(backend.JacNonzeros());
+  vector<int> cols(backend.JacNonzeros());
+  vector<double> values(backend.JacNonzeros());
+  backend.JacStructure(rows.data(), cols.data());
+  backend.EvalJacG(w.data(), false, values.data());
+  Eigen::MatrixXd J = Eigen::MatrixXd::Zero(n_constraints, n_vars);
+  for (size_t k = 0; k < values.size(); k++) {
+    J(row_index[rows[k]], rti.index[cols[k]]) += values[k];
+  }
+
+  // The cost is a sum of squares of affine functions of the variables, so
+  // the Hessian of the cost alone is its exact Gauss-Newton Hessian.
+  Eigen::VectorXd grad(n_vars);
+  backend.EvalGradF(w.data(), false, value.data());
+  for (size_t var = 0; var < n_vars; var++) {
+    grad[rti.index[var]] = value[var];
+  }
+  vector<double> lambda(n_constraints, 0.0);
+  rows.resize(backend.HesNonzeros());
+  cols.resize(backend.HesNonzeros());
+  values.resize(backend.HesNonzeros());
+  backend.HesStructure(rows.data(), cols.data());
+  backend.EvalH(w.data(), false, 1.0, lambda.data(), values.data());
+  Eigen::MatrixXd H = Eigen::MatrixXd::Zero(n_vars, n_vars);
+  for (size_t k = 0; k < values.size(); k++) {
+    size_t row = rti.index[rows[k]];
+    size_t col = rti.index[cols[k]];
+    H(row, col) += values[k];
+    if (row != col) {
+      H(col, row) += values[k];
+    }
+  }
+
+  // The states come first in the layout and their Jacobian is block lower
+  // triangular with an identity diagonal, so the linearized dynamics
+  //   J_s ds + J_u du = b - g,
+  // where b is the initial state on the initial state rows, give the state
+  // steps as an affine function of x0 and du.
+  size_t n_s = n_state * N;
+  size_t n_u = n_vars - n_s;
+  Eigen::PartialPivLU<Eigen::MatrixXd> J_s(J.leftCols(n_s));
+  // the initial state rows are the first row of each state block
+  Eigen::MatrixXd E = Eigen::MatrixXd::Zero(n_s, n_state);
+  for (unsigned int i = 0; i < n_state; i++) {
+    E(canonical.Row(i, 0), i) = 1.0;
+  }
+  rti.s0 = J_s.solve(-g);
+  rti.S_x0 = J_s.solve(E);
+  rti.S_du = -J_s.solve(J.rightCols(n_u));
+
+  // T = [S_du; I] maps du to the full step
+  Eigen::MatrixXd T(n_vars, n_u);
+  T.topRows(n_s) = rti.S_du;
+  T.bottomRows(n_u) = Eigen::MatrixXd::Identity(n_u, n_u);
+  Eigen::MatrixXd H_s = H.leftCols(n_s);
+  rti.H = T.transpose() * H * T;
+  rti.g = T.transpose() * (H_s * rti.s0 + grad);
+  rti.G_x0 = T.transpose() * (H_s * rti.S_x0);
+
+  rti.vars.resize(n_vars);
+  for (size_t var = 0; var < n_vars; var++) {
+    rti.vars[rti.index[var]] = w[var];
+  }
+  rti.x = frame_x;
+  rti.y = frame_y;
+  rti.psi = frame_psi;
+  rti.prepared = true;
+}
+
+MPC_result MPC::Feedback(const Eigen::VectorXd& state,
+                         const Eigen::VectorXd& coeffs,
+                         chrono::steady_clock::time_point deadline) {
+  if (!rti.prepared || !frame_valid) {
+    return Optimize(state, coeffs, deadline);
+  }
+  rti.prepared = false;
+
+  // Move the state into the frame of the linearization. cte and epsi are
+  // relative to the path and stay as they are.
+  double dx = frame_x - rti.x;
+  double dy = frame_y - rti.y;
+  double ox = dx * cos(rti.psi) + dy * sin(rti.psi);
+  double oy = -dx * sin(rti.psi) + dy * cos(rti.psi);
+  double dpsi = frame_psi - rti.psi;
+  Eigen::VectorXd x0(n_state);
+  x0 << ox + state[0] * cos(dpsi) - state[1] * sin(dpsi),
+      oy + state[0] * sin(dpsi) + state[1] * cos(dpsi), state[2] + dpsi,
+      state[3], state[4], state[5];
+
+  // actuator steps within the bounds
+  size_t n_s = n_state * N;
+  size_t n_u = n_vars - n_s;
+  Eigen::VectorXd lb(n_u);
+  Eigen::VectorXd ub(n_u);
+  for (size_t var = 0; var < n_vars; var++) {
+    size_t i = rti.index[var];
+    if (i >= n_s) {
+      lb[i - n_s] = nlp->vars_lowerbound[var] - rti.vars[i];
+      ub[i - n_s] = nlp->vars_upperbound[var] - rti.vars[i];
+    }
+  }
+  Eigen::VectorXd du = Eigen::VectorXd::Zero(n_u);
+  int iterations = SolveBoxQP(rti.H, rti.g + rti.G_x0 * x0, lb, ub, du);
+  if (iterations < 0) {
+    return Optimize(state, coeffs, deadline);
+  }
+  Eigen::VectorXd ds = rti.s0 + rti.S_x0 * x0 + rti.S_du * du;
+
+  // the full step is taken, the result is the next linearization point;
+  // there are no multipliers for a later warm start of Ipopt
+  MPC_NLP::Solution& solution = nlp->solution;
+  for (size_t var = 0; var < n_vars; var++) {
+    size_t i = rti.index[var];
+    solution.x[var] = rti.vars[i] + (i < n_s ? ds[i] : du[i - n_s]);
+    solution.z_L[var] = 0.0;
+    solution.z_U[var] = 0.0;
+  }
+  for (size_t row = 0; row < n_constraints; row++) {
+    solution.lambda[row] = 0.0;
+  }
+  // the cost on the path of the linearization, see Prepare
+  solution.obj_value = nlp->backend->EvalF(solution.x.data(), true);
+  solution.status = Ipopt::SUCCESS;
+  solution.iterations = iterations;
+  solution.feasible = true;
+  plan_x = rti.x;
+  plan_y = rti.y;
+  plan_psi = rti.psi;
+  plan_valid = true;
+
+  MPC_result result;
+  result.status = MPC_result::CONVERGED;
+  result.iterations = iterations;
+  MPC_layout::Stage s = layout.Vars(0);
+  result.delta = solution.x[s.delta];
+  result.a = solution.x[s.a];
+
+  // the predicted trajectory goes back into the current frame
+  for (unsigned int i = 0; i < N; i++) {
+    double px = solution.x[layout.State(MPC_layout::X, i)];
+    double py = solution.x[layout.State(MPC_layout::Y, i)];
+    double ex = rti.x + px * cos(rti.psi) - py * sin(rti.psi) - frame_x;
+    double ey = rti.y + px * sin(rti.psi) + py * cos(rti.psi) - frame_y;
+    result.x.push_back(ex * cos(frame_psi) + ey * sin(frame_psi));
+    result.y.push_back(-ex * sin(frame_psi) + ey * cos(frame_psi));
+  }
+  return result;
+}
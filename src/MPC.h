@@ -1,20 +1,269 @@
 #ifndef MPC_H
 #define MPC_H
 
+#include <chrono>
+#include <memory>
 #include <vector>
+#include <coin/IpAlgBuilder.hpp>
+#include <coin/IpIpoptApplication.hpp>
+#include <coin/IpTNLPAdapter.hpp>
 #include "Eigen-3.3/Eigen/Core"
+#include "Controller.h"
+#include "MPC_NLP.h"
+#include "MPC_integrator.h"
+#include "MPC_layout.h"
+#include "MPC_model.h"
 
 using namespace std;
 
-class MPC {
+class ILQR;
+class MPPI;
+class Pure_pursuit;
+class QP_admm;
+
+// Parameters of the problem. Every MPC object has its own, so controllers
+// with different settings can solve side by side, also on different
+// threads.
+struct MPC_config {
+  // the defaults of MPC_model.h
+  MPC_config();
+
+  // number of stages and the time between them
+  size_t N;
+  double dt;
+  // Lengths of the N - 1 steps when they are not uniform, e.g. five of
+  // 0.05 s followed by five of 0.2 s. Set, they replace N and dt: the
+  // horizon has steps.size() + 1 stages.
+  vector<double> steps;
+  // Integration of the model over each step. Other than the single Euler
+  // step, the derivatives come from the tape whatever the backend asked for;
+  // iLQR, MPPI and MPC_frenet keep their Euler models.
+  MPC_integrator integrator;
+  // reference velocity of the cost
+  double ref_v;
+  // threads of the MPPI rollouts, 0 for one per hardware thread
+  int threads;
+  // order of the variables and constraints, see MPC_layout
+  MPC_layout::Order layout;
+  // Lengths of the move blocks, the last one repeats to the end of the
+  // horizon; empty for one actuation per step. Only Ipopt and the ADMM SQP
+  // solve blocked problems, the other optimizers fail on them and the
+  // real-time iteration falls back to Solve.
+  vector<size_t> blocks;
+
+  // Linear solver of the Ipopt steps.
+  enum LinearSolver {
+    // the one of the Ipopt build
+    MUMPS,
+    // sparse LDLT of Eigen, see KKT_ldlt
+    EIGEN_LDLT
+  };
+  LinearSolver linear_solver;
+
+  // Hessian of the Lagrangian in the Ipopt steps.
+  enum Hessian {
+    // exact, from the backend
+    EXACT,
+    // the Gauss-Newton matrix of the cost, see MPC_NLP::gauss_newton
+    GAUSS_NEWTON,
+    // limited-memory BFGS approximation of Ipopt
+    LBFGS
+  };
+  Hessian hessian;
+};
+
+// Any number of MPC objects may solve at once on different threads. Ipopt
+// solves take turns (the MUMPS build of Ipopt 3.12 is not reentrant), the
+// other optimizers run concurrently.
+class MPC : public Controller {
  public:
-  MPC();
+  // Source of the derivatives of the cost and constraints.
+  enum Derivatives {
+    // sparse derivatives of the recorded FG_eval tape
+    CPPAD,
+    // hand-derived derivatives, see FG_analytic
+    ANALYTIC,
+    // kernels generated from FG_eval at build time, see FG_generated
+    GENERATED
+  };
+
+  // `horizon` is the number of stages N of the problem.
+  MPC(Derivatives derivatives = GENERATED, size_t horizon = ::N);
+
+  explicit MPC(const MPC_config& config, Derivatives derivatives = GENERATED);
 
   virtual ~MPC();
 
-  // Solve the model given an initial state and polynomial coefficients.
-  // Return the first actuations.
-  vector<double> Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs);
+  // Global pose of the vehicle frame that the next state and coefficients
+  // are expressed in. It is needed to re-project the previous plan into the
+  // new frame for the warm start.
+  void SetFrame(double px, double py, double psi);
+
+  // Seed each solve with the previous solution and multipliers shifted by
+  // one step. Turned off, every solve starts from zero.
+  bool warm_start;
+
+  // Initial guess of a solve.
+  enum Start {
+    // the previous solution shifted by one step, see warm_start
+    SHIFTED,
+    // zero
+    ZERO,
+    // the model held at the steering angle of the path curvature under the
+    // vehicle, a constant-curvature arc at constant speed
+    ARC,
+    // the model driven by Pure_pursuit
+    PURSUIT
+  };
+  Start start;
+
+  // Stop a solve running on another thread at its next iteration, as at the
+  // deadline; later solves stop at once until Cancel(false). iLQR and MPPI
+  // only stop at the deadline.
+  void Cancel(bool cancel = true) { nlp->cancel = cancel; }
+
+  // Cost of the last solution.
+  double Cost() const { return nlp->solution.obj_value; }
+
+  // Take the last solution of `other`, an MPC of the same problem, as the
+  // one to shift for the next warm start.
+  void CopySolution(const MPC& other);
+
+  // Optimizer behind Solve.
+  enum Optimizer {
+    // Ipopt on the sparse problem
+    IPOPT,
+    // SQP on the stage structure, see OptimizeRiccati
+    RICCATI,
+    // SQP with operator-splitting QP steps, see OptimizeADMM
+    ADMM,
+    // iterative LQR on the actuations, see ILQR
+    ILQR,
+    // sampling-based path integral control, see MPPI
+    MPPI
+  };
+  Optimizer optimizer;
+
+  // Real-time iteration: instead of solving to convergence, every tick
+  // takes a single Gauss-Newton SQP step from the shifted last trajectory.
+  // Solve only solves the QP condensed by Prepare for the measured state and
+  // applies the step, so only this phase runs between the telemetry and the
+  // actuation. Without a prepared linearization (first tick, failed step)
+  // it solves with the optimizer.
+  bool real_time_iteration;
+
+  // With real_time_iteration, linearize the model around the last
+  // trajectory shifted into the frame of SetFrame and condense the QP. Run
+  // it after the actuation is sent, while waiting for the next telemetry.
+  void Prepare(const Eigen::VectorXd& coeffs);
+
+  // Evaluation backend of the problem, e.g. to compare the derivatives.
+  FG_backend& Backend() { return *nlp->backend; }
+
+ protected:
+  // Solve the model given an initial state and polynomial coefficients with
+  // the optimizer. The solver is stopped at the wall-clock `deadline`.
+  MPC_result Plan(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  chrono::steady_clock::time_point deadline);
+
+ private:
+  // Problem parameters of the config, the length of each step.
+  vector<double> dt;
+  MPC_integrator integrator;
+  double ref_v;
+  int threads;
+
+  // Horizon and the position of the variables and constraints.
+  size_t N;
+  MPC_layout layout;
+  size_t n_vars;
+  size_t n_constraints;
+
+  // Ipopt problem holding the evaluation backend chosen at construction.
+  Ipopt::SmartPtr<MPC_NLP> nlp;
+
+  // Long-lived solver, re-optimized on every call of Solve.
+  Ipopt::SmartPtr<Ipopt::IpoptApplication> app;
+  bool optimized;
+
+  // With the Eigen linear solver, Ipopt is built from `builder` and solves
+  // `nlp` through `adapter`, which the application keeps for the later
+  // re-optimizations.
+  Ipopt::SmartPtr<Ipopt::AlgorithmBuilder> builder;
+  Ipopt::SmartPtr<Ipopt::TNLPAdapter> adapter;
+
+  // Pose of the frame of the next solve and of the last solution.
+  double frame_x, frame_y, frame_psi;
+  double plan_x, plan_y, plan_psi;
+  bool frame_valid;
+  bool plan_valid;
+
+  // Solve with the optimizer, see Plan.
+  MPC_result Optimize(const Eigen::VectorXd& state,
+                      const Eigen::VectorXd& coeffs,
+                      chrono::steady_clock::time_point deadline);
+
+  // Solve the prepared QP of the real-time iteration for `state`.
+  MPC_result Feedback(const Eigen::VectorXd& state,
+                      const Eigen::VectorXd& coeffs,
+                      chrono::steady_clock::time_point deadline);
+
+  // Write the last solution shifted by one step into the starting point.
+  bool ShiftSolution(const Eigen::VectorXd& coeffs);
+
+  // Write the rollout of the model from `state` with the actuations of
+  // `start` into the starting point.
+  void Rollout(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs);
+
+  // Solve the problem set up in `nlp` with the structure-exploiting SQP and
+  // write the result into its solution, like Ipopt would.
+  void OptimizeRiccati();
+
+  // The same with the QP steps solved by ADMM on the sparse problem.
+  void OptimizeADMM();
+
+  // Solve the problem set up in `nlp` with iLQR for the path `params`.
+  void OptimizeILQR(const double* params);
+
+  // Solve the problem set up in `nlp` with MPPI for the path `params`.
+  void OptimizeMPPI(const double* params);
+
+  // Write the result `w` of an SQP into the solution of `nlp`.
+  void StoreSolution(const Eigen::VectorXd& w, Ipopt::SolverReturn status,
+                     int iterations);
+
+  // ADMM solver of OptimizeADMM, it keeps its factorization and iterates
+  // from one solve to the next.
+  std::unique_ptr<QP_admm> admm;
+
+  // iLQR solver of OptimizeILQR.
+  std::unique_ptr<::ILQR> ilqr;
+
+  // MPPI controller of OptimizeMPPI, with its thread pool.
+  std::unique_ptr<::MPPI> mppi;
+
+  // Pure pursuit of the PURSUIT start.
+  std::unique_ptr<Pure_pursuit> pursuit;
+
+  // QP of the real-time iteration condensed on the actuator steps du. The
+  // state steps are ds = s0 + S_x0 * x0 + S_du * du for the initial state
+  // x0, the cost is 0.5 * du' H du + (g + G_x0 * x0)' du. The vectors and
+  // matrices are in the variable-major layout, whatever the problem uses.
+  struct Linearization {
+    bool prepared;
+    // trajectory of the linearization, in the frame x, y, psi
+    Eigen::VectorXd vars;
+    double x, y, psi;
+    Eigen::VectorXd s0;
+    Eigen::MatrixXd S_x0;
+    Eigen::MatrixXd S_du;
+    Eigen::MatrixXd H;
+    Eigen::VectorXd g;
+    Eigen::MatrixXd G_x0;
+    // position of each variable of the problem in them
+    vector<size_t> index;
+  };
+  Linearization rti;
 };
 
 #endif /* MPC_H */
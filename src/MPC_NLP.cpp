@@ -0,0 +1,231 @@
+#include "MPC_NLP.h"
+#include <coin/IpIpoptCalculatedQuantities.hpp>
+#include <coin/IpIpoptData.hpp>
+#include <coin/IpOrigIpoptNLP.hpp>
+#include <coin/IpTNLPAdapter.hpp>
+
+using Ipopt::Index;
+using Ipopt::Number;
+
+MPC_NLP::MPC_NLP(FG_backend* backend) : backend(backend) {
+  size_t n_vars = backend->NumVars();
+  size_t n_constraints = backend->NumConstraints();
+  this->vars.resize(n_vars);
+  z_L.resize(n_vars);
+  z_U.resize(n_vars);
+  lambda.resize(n_constraints);
+  warm_start = false;
+  vars_lowerbound.resize(n_vars);
+  vars_upperbound.resize(n_vars);
+  constraints_lowerbound.resize(n_constraints);
+  constraints_upperbound.resize(n_constraints);
+  solution.status = Ipopt::UNASSIGNED;
+  solution.x.resize(n_vars);
+  solution.z_L.resize(n_vars);
+  solution.z_U.resize(n_vars);
+  solution.lambda.resize(n_constraints);
+  solution.obj_value = 0.0;
+  solution.iterations = 0;
+  solution.feasible = false;
+
+  deadline = std::chrono::steady_clock::time_point::max();
+  cancel = false;
+  feasibility_tol = 1e-4;
+  gauss_newton = false;
+  best_x.resize(n_vars);
+  best_obj = 0.0;
+  best_valid = false;
+  iterations = 0;
+}
+
+bool MPC_NLP::get_nlp_info(Index& n, Index& m, Index& nnz_jac_g,
+                           Index& nnz_h_lag, IndexStyleEnum& index_style) {
+  n = backend->NumVars();
+  m = backend->NumConstraints();
+  nnz_jac_g = backend->JacNonzeros();
+  nnz_h_lag = backend->HesNonzeros();
+  if (gauss_newton) {
+    CostHessian();
+    nnz_h_lag = gn_values.size();
+  }
+  index_style = C_STYLE;
+  return true;
+}
+
+bool MPC_NLP::get_bounds_info(Index n, Number* x_l, Number* x_u, Index m,
+                              Number* g_l, Number* g_u) {
+  for (Index i = 0; i < n; i++) {
+    x_l[i] = vars_lowerbound[i];
+    x_u[i] = vars_upperbound[i];
+  }
+  for (Index i = 0; i < m; i++) {
+    g_l[i] = constraints_lowerbound[i];
+    g_u[i] = constraints_upperbound[i];
+  }
+  return true;
+}
+
+bool MPC_NLP::get_starting_point(Index n, bool init_x, Number* x, bool init_z,
+                                 Number* z_L, Number* z_U, Index m,
+                                 bool init_lambda, Number* lambda) {
+  // the multipliers are only available for a warm start
+  if ((init_z || init_lambda) && !warm_start) {
+    return false;
+  }
+  // a new optimization starts
+  best_valid = false;
+  iterations = 0;
+  if (init_x) {
+    for (Index i = 0; i < n; i++) {
+      x[i] = vars[i];
+    }
+  }
+  if (init_z) {
+    for (Index i = 0; i < n; i++) {
+      z_L[i] = this->z_L[i];
+      z_U[i] = this->z_U[i];
+    }
+  }
+  if (init_lambda) {
+    for (Index i = 0; i < m; i++) {
+      lambda[i] = this->lambda[i];
+    }
+  }
+  return true;
+}
+
+bool MPC_NLP::eval_f(Index n, const Number* x, bool new_x, Number& obj_value) {
+  obj_value = backend->EvalF(x, new_x);
+  return true;
+}
+
+bool MPC_NLP::eval_grad_f(Index n, const Number* x, bool new_x,
+                          Number* grad_f) {
+  backend->EvalGradF(x, new_x, grad_f);
+  return true;
+}
+
+bool MPC_NLP::eval_g(Index n, const Number* x, bool new_x, Index m,
+                     Number* g) {
+  backend->EvalG(x, new_x, g);
+  return true;
+}
+
+bool MPC_NLP::eval_jac_g(Index n, const Number* x, bool new_x, Index m,
+                         Index nele_jac, Index* iRow, Index* jCol,
+                         Number* values) {
+  if (values == NULL) {
+    backend->JacStructure(iRow, jCol);
+  } else {
+    backend->EvalJacG(x, new_x, values);
+  }
+  return true;
+}
+
+bool MPC_NLP::eval_h(Index n, const Number* x, bool new_x, Number obj_factor,
+                     Index m, const Number* lambda, bool new_lambda,
+                     Index nele_hess, Index* iRow, Index* jCol,
+                     Number* values) {
+  if (gauss_newton) {
+    for (size_t k = 0; k < gn_values.size(); k++) {
+      if (values == NULL) {
+        iRow[k] = gn_rows[k];
+        jCol[k] = gn_cols[k];
+      } else {
+        values[k] = obj_factor * gn_values[k];
+      }
+    }
+  } else if (values == NULL) {
+    backend->HesStructure(iRow, jCol);
+  } else {
+    backend->EvalH(x, new_x, obj_factor, lambda, values);
+  }
+  return true;
+}
+
+// The Hessian of the cost does not depend on the variables or the
+// parameters, it is the Hessian of the backend without multipliers at any
+// point.
+void MPC_NLP::CostHessian() {
+  if (!gn_values.empty()) {
+    return;
+  }
+  size_t nnz = backend->HesNonzeros();
+  std::vector<Index> rows(nnz);
+  std::vector<Index> cols(nnz);
+  std::vector<double> values(nnz);
+  std::vector<double> x(backend->NumVars(), 0.0);
+  std::vector<double> lambda(backend->NumConstraints(), 0.0);
+  backend->HesStructure(rows.data(), cols.data());
+  backend->EvalH(x.data(), true, 1.0, lambda.data(), values.data());
+  for (size_t k = 0; k < nnz; k++) {
+    if (values[k] != 0.0) {
+      gn_rows.push_back(rows[k]);
+      gn_cols.push_back(cols[k]);
+      gn_values.push_back(values[k]);
+    }
+  }
+}
+
+void MPC_NLP::finalize_solution(Ipopt::SolverReturn status, Index n,
+                                const Number* x, const Number* z_L,
+                                const Number* z_U, Index m, const Number* g,
+                                const Number* lambda, Number obj_value,
+                                const Ipopt::IpoptData* ip_data,
+                                Ipopt::IpoptCalculatedQuantities* ip_cq) {
+  solution.status = status;
+  for (Index i = 0; i < n; i++) {
+    solution.x[i] = x[i];
+    solution.z_L[i] = z_L[i];
+    solution.z_U[i] = z_U[i];
+  }
+  for (Index i = 0; i < m; i++) {
+    solution.lambda[i] = lambda[i];
+  }
+  solution.obj_value = obj_value;
+  solution.iterations = iterations;
+  solution.feasible = status != Ipopt::USER_REQUESTED_STOP || best_valid;
+
+  // stopped at the deadline, fall back to the best feasible iterate; its
+  // multipliers were not kept, so there are none for a later warm start
+  if (status == Ipopt::USER_REQUESTED_STOP && best_valid) {
+    for (Index i = 0; i < n; i++) {
+      solution.x[i] = best_x[i];
+      solution.z_L[i] = 0.0;
+      solution.z_U[i] = 0.0;
+    }
+    for (Index i = 0; i < m; i++) {
+      solution.lambda[i] = 0.0;
+    }
+    solution.obj_value = best_obj;
+  }
+}
+
+bool MPC_NLP::intermediate_callback(
+    Ipopt::AlgorithmMode mode, Index iter, Number obj_value, Number inf_pr,
+    Number inf_du, Number mu, Number d_norm, Number regularization_size,
+    Number alpha_du, Number alpha_pr, Index ls_trials,
+    const Ipopt::IpoptData* ip_data, Ipopt::IpoptCalculatedQuantities* ip_cq) {
+  iterations = iter;
+
+  // The iterate itself is only reachable through the adapter that Ipopt
+  // wraps around this TNLP.
+  if (mode == Ipopt::RegularMode && inf_pr <= feasibility_tol &&
+      (!best_valid || obj_value < best_obj) && ip_data != NULL &&
+      ip_cq != NULL) {
+    Ipopt::OrigIpoptNLP* orignlp = dynamic_cast<Ipopt::OrigIpoptNLP*>(
+        Ipopt::GetRawPtr(ip_cq->GetIpoptNLP()));
+    Ipopt::TNLPAdapter* adapter = NULL;
+    if (orignlp != NULL) {
+      adapter = dynamic_cast<Ipopt::TNLPAdapter*>(
+          Ipopt::GetRawPtr(orignlp->nlp()));
+    }
+    if (adapter != NULL) {
+      adapter->ResortX(*ip_data->curr()->x(), &best_x[0]);
+      best_obj = obj_value;
+      best_valid = true;
+    }
+  }
+
+  return !Stopped();
+}
@@ -0,0 +1,138 @@
+#ifndef MPC_NLP_H
+#define MPC_NLP_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cppad/cppad.hpp>
+#include <coin/IpTNLP.hpp>
+#include "FG_backend.h"
+
+// Ipopt view of the MPC problem. The cost, constraints and their derivatives
+// come from an evaluation backend (the recorded FG_eval tape or the analytic
+// derivatives); the bounds and the starting point are filled in by MPC::Solve
+// before each optimization.
+class MPC_NLP : public Ipopt::TNLP {
+ public:
+  typedef CPPAD_TESTVECTOR(double) Dvector;
+
+  struct Solution {
+    Ipopt::SolverReturn status;
+    Dvector x;
+    Dvector z_L;
+    Dvector z_U;
+    Dvector lambda;
+    double obj_value;
+    int iterations;
+    // False when the solver stopped at the deadline before it found a
+    // feasible iterate. Otherwise `x` is the best feasible iterate.
+    bool feasible;
+  };
+
+  // Takes ownership of `backend`.
+  explicit MPC_NLP(FG_backend* backend);
+
+  std::unique_ptr<FG_backend> backend;
+
+  // Starting point and bounds of the next optimization. The bound and
+  // constraint multipliers are only used for a warm start.
+  Dvector vars;
+  Dvector z_L;
+  Dvector z_U;
+  Dvector lambda;
+  bool warm_start;
+  Dvector vars_lowerbound;
+  Dvector vars_upperbound;
+  Dvector constraints_lowerbound;
+  Dvector constraints_upperbound;
+
+  // Wall-clock time at which the optimization is stopped.
+  std::chrono::steady_clock::time_point deadline;
+  // Set from another thread, stops the optimization like the deadline.
+  std::atomic<bool> cancel;
+  // Whether the deadline has passed or the optimization was cancelled.
+  bool Stopped() const {
+    return cancel || std::chrono::steady_clock::now() >= deadline;
+  }
+  // Primal infeasibility below which an iterate counts as feasible.
+  double feasibility_tol;
+
+  // Replace the Hessian of the Lagrangian by the Gauss-Newton matrix J'WJ
+  // of the residuals of the cost. Every term of the cost is a weighted
+  // square of an affine function of the variables, so J'WJ is the Hessian
+  // of the cost alone: constant, positive semidefinite and with a smaller
+  // pattern; the curvature of the model constraints is left out. Set
+  // before the first optimization.
+  bool gauss_newton;
+
+  // Result of the last optimization.
+  Solution solution;
+
+  bool get_nlp_info(Ipopt::Index& n, Ipopt::Index& m, Ipopt::Index& nnz_jac_g,
+                    Ipopt::Index& nnz_h_lag, IndexStyleEnum& index_style);
+
+  bool get_bounds_info(Ipopt::Index n, Ipopt::Number* x_l, Ipopt::Number* x_u,
+                       Ipopt::Index m, Ipopt::Number* g_l, Ipopt::Number* g_u);
+
+  bool get_starting_point(Ipopt::Index n, bool init_x, Ipopt::Number* x,
+                          bool init_z, Ipopt::Number* z_L, Ipopt::Number* z_U,
+                          Ipopt::Index m, bool init_lambda,
+                          Ipopt::Number* lambda);
+
+  bool eval_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number& obj_value);
+
+  bool eval_grad_f(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                   Ipopt::Number* grad_f);
+
+  bool eval_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Index m, Ipopt::Number* g);
+
+  bool eval_jac_g(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+                  Ipopt::Index m, Ipopt::Index nele_jac, Ipopt::Index* iRow,
+                  Ipopt::Index* jCol, Ipopt::Number* values);
+
+  bool eval_h(Ipopt::Index n, const Ipopt::Number* x, bool new_x,
+              Ipopt::Number obj_factor, Ipopt::Index m,
+              const Ipopt::Number* lambda, bool new_lambda,
+              Ipopt::Index nele_hess, Ipopt::Index* iRow, Ipopt::Index* jCol,
+              Ipopt::Number* values);
+
+  void finalize_solution(Ipopt::SolverReturn status, Ipopt::Index n,
+                         const Ipopt::Number* x, const Ipopt::Number* z_L,
+                         const Ipopt::Number* z_U, Ipopt::Index m,
+                         const Ipopt::Number* g, const Ipopt::Number* lambda,
+                         Ipopt::Number obj_value,
+                         const Ipopt::IpoptData* ip_data,
+                         Ipopt::IpoptCalculatedQuantities* ip_cq);
+
+  // Tracks the best feasible iterate and stops at the deadline or when
+  // cancelled.
+  bool intermediate_callback(Ipopt::AlgorithmMode mode, Ipopt::Index iter,
+                             Ipopt::Number obj_value, Ipopt::Number inf_pr,
+                             Ipopt::Number inf_du, Ipopt::Number mu,
+                             Ipopt::Number d_norm,
+                             Ipopt::Number regularization_size,
+                             Ipopt::Number alpha_du, Ipopt::Number alpha_pr,
+                             Ipopt::Index ls_trials,
+                             const Ipopt::IpoptData* ip_data,
+                             Ipopt::IpoptCalculatedQuantities* ip_cq);
+
+ private:
+  // Evaluate the Gauss-Newton matrix once, keeping its nonzeros.
+  void CostHessian();
+
+  // Gauss-Newton matrix for an objective factor of 1
+  std::vector<Ipopt::Index> gn_rows;
+  std::vector<Ipopt::Index> gn_cols;
+  std::vector<double> gn_values;
+
+  // Best feasible iterate of the running optimization.
+  Dvector best_x;
+  double best_obj;
+  bool best_valid;
+  int iterations;
+};
+
+#endif /* MPC_NLP_H */
@@ -0,0 +1,140 @@
+#include "MPC_adaptive.h"
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+// Preview time and number of stages of a problem.
+static double PreviewOf(const MPC_config& config) {
+  if (!config.steps.empty()) {
+    return accumulate(config.steps.begin(), config.steps.end(), 0.0);
+  }
+  return (config.N - 1) * config.dt;
+}
+
+static size_t StagesOf(const MPC_config& config) {
+  return config.steps.empty() ? config.N : config.steps.size() + 1;
+}
+
+MPC_adaptive::MPC_adaptive(const vector<MPC_config>& configs,
+                           MPC::Derivatives derivatives) {
+  vector<size_t> order(configs.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  sort(order.begin(), order.end(), [&configs](size_t i, size_t j) {
+    return PreviewOf(configs[i]) < PreviewOf(configs[j]);
+  });
+  for (size_t i : order) {
+    controllers.emplace_back(new MPC(configs[i], derivatives));
+    stages.push_back(StagesOf(configs[i]));
+    preview.push_back(PreviewOf(configs[i]));
+    estimate.push_back(-1.0);
+  }
+  solves.assign(configs.size(), 0);
+  chosen = -1;
+
+  // about the preview of N = 10 at the reference speed, and a quarter turn
+  preview_distance = 60.0;
+  max_turn = M_PI / 4;
+  budget = 0.5;
+  smoothing = 0.2;
+}
+
+vector<MPC_config> MPC_adaptive::Horizons(const MPC_config& config,
+                                          const vector<size_t>& horizons) {
+  vector<MPC_config> configs;
+  for (size_t N : horizons) {
+    configs.push_back(config);
+    configs.back().N = N;
+    configs.back().steps.clear();
+  }
+  return configs;
+}
+
+void MPC_adaptive::SetOptimizer(MPC::Optimizer optimizer) {
+  for (auto& mpc : controllers) {
+    mpc->optimizer = optimizer;
+  }
+}
+
+void MPC_adaptive::SetFrame(double px, double py, double psi) {
+  for (auto& mpc : controllers) {
+    mpc->SetFrame(px, py, psi);
+  }
+}
+
+int MPC_adaptive::Choose(double wanted, double left) const {
+  // the longest preview up to the wanted one that fits, else the shortest
+  // that fits, else the fastest
+  int longest = -1;
+  int shortest = -1;
+  int fastest = 0;
+  for (size_t i = 0; i < controllers.size(); i++) {
+    if (estimate[i] < estimate[fastest]) {
+      fastest = i;
+    }
+    if (estimate[i] > budget * left) {
+      continue;
+    }
+    if (preview[i] <= wanted) {
+      longest = i;
+    } else if (shortest < 0) {
+      shortest = i;
+    }
+  }
+  if (longest >= 0) {
+    return longest;
+  }
+  return shortest >= 0 ? shortest : fastest;
+}
+
+MPC_result MPC_adaptive::Plan(const Eigen::VectorXd& state,
+                              const Eigen::VectorXd& coeffs,
+                              chrono::steady_clock::time_point deadline) {
+  auto start = chrono::steady_clock::now();
+  double left = chrono::duration<double>(deadline - start).count();
+
+  // Walk along the path until its heading has turned by max_turn, the
+  // wanted preview is the time to get there.
+  double heading = atan(coeffs[1]);
+  double distance = 1.0;
+  for (; distance < preview_distance; distance += 1.0) {
+    double x = distance;
+    double slope = coeffs[1] + 2 * coeffs[2] * x + 3 * coeffs[3] * x * x;
+    if (fabs(atan(slope) - heading) > max_turn) {
+      break;
+    }
+  }
+  double wanted = distance / max(state[3], 1.0);
+
+  int i = Choose(wanted, left);
+  MPC& mpc = *controllers[i];
+
+  // the last plan of another candidate is from an older tick
+  bool warm_start = mpc.warm_start;
+  mpc.warm_start = warm_start && i == chosen;
+  MPC_result result = mpc.Solve(state, coeffs, deadline);
+  mpc.warm_start = warm_start;
+  chosen = i;
+  solves[i]++;
+
+  // Update the estimates. Those not measured yet start from this one,
+  // scaled by the number of stages.
+  double measured =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  double ratio = estimate[i] > 0.0 ? measured / estimate[i] : 1.0;
+  for (size_t j = 0; j < controllers.size(); j++) {
+    if ((int)j == i) {
+      estimate[j] = estimate[j] > 0.0
+                        ? (1 - smoothing) * estimate[j] + smoothing * measured
+                        : measured;
+    } else if (estimate[j] > 0.0) {
+      estimate[j] *= (1 - smoothing) + smoothing * ratio;
+    } else {
+      estimate[j] = measured * stages[j] / stages[i];
+    }
+  }
+  return result;
+}
@@ -0,0 +1,80 @@
+#ifndef MPC_ADAPTIVE_H
+#define MPC_ADAPTIVE_H
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+// Controller that chooses the horizon of every tick among a set of
+// problems, e.g. N = 8, 10, 12, 15 and 20 at the same dt (--adaptive of
+// main.cpp), or different step lengths.
+//
+// Every candidate is an MPC object built once, so its tape, sparsity
+// patterns and solver state are kept and switching costs nothing. The
+// wanted preview follows the telemetry: the distance covered at the current
+// speed, shortened where the path ahead turns sharply (the kinematic model
+// is poor there, see the tuning notes of MPC_model.h). Of the candidates
+// whose estimated solve time fits into the time left until the deadline,
+// the one with the longest preview up to the wanted one solves.
+//
+// The estimates are running averages of the measured wall times. The
+// machine load affects all candidates alike, so the ratio of the measured
+// time to the estimate of the solved candidate scales the others as well:
+// a loaded machine backs off to shorter horizons, and they grow again once
+// the load is gone.
+class MPC_adaptive : public Controller {
+ public:
+  // Candidates in any order.
+  MPC_adaptive(const std::vector<MPC_config>& configs,
+               MPC::Derivatives derivatives = MPC::ANALYTIC);
+
+  // Candidates with the horizons `horizons` and the rest of `config`.
+  static std::vector<MPC_config> Horizons(const MPC_config& config,
+                                          const std::vector<size_t>& horizons);
+
+  // Optimizer of all candidates, see MPC::optimizer.
+  void SetOptimizer(MPC::Optimizer optimizer);
+
+  // See MPC::SetFrame.
+  void SetFrame(double px, double py, double psi);
+
+  // Preview wanted ahead of the vehicle, and the largest change of the
+  // path heading over it in radians: at curvature k the preview ends after
+  // max_turn / k.
+  double preview_distance;
+  double max_turn;
+  // share of the time left until the deadline an estimate may take
+  double budget;
+  // weight of a new measurement in the running averages
+  double smoothing;
+
+  // candidate of the last solve, and the number of solves of each one
+  int chosen;
+  std::vector<int> solves;
+
+  // Number of candidates, and their preview time and solve time estimate
+  // in seconds, less than zero before the first solve.
+  size_t Candidates() const { return controllers.size(); }
+  double Preview(size_t i) const { return preview[i]; }
+  double Estimate(size_t i) const { return estimate[i]; }
+
+ protected:
+  // Solve with the candidate chosen for the speed in `state`, the path
+  // `coeffs` and the time left until `deadline`.
+  MPC_result Plan(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  std::chrono::steady_clock::time_point deadline);
+
+ private:
+  // Index of the candidate for the wanted `preview` and the time `left`.
+  int Choose(double preview, double left) const;
+
+  // candidates by increasing preview
+  std::vector<std::unique_ptr<MPC> > controllers;
+  std::vector<size_t> stages;
+  std::vector<double> preview;
+  std::vector<double> estimate;
+};
+
+#endif /* MPC_ADAPTIVE_H */
@@ -0,0 +1,265 @@
+#ifndef MPC_FIXED_H
+#define MPC_FIXED_H
+
+#include <math.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "MPC_model.h"
+#include "QP_riccati.h"
+
+// The problem of MPC with the horizon a compile-time constant.
+//
+// The dimensions are constexpr and the state, the path and the result are
+// fixed-size, so the loops over the stages and states unroll and Solve
+// allocates nothing; the stage blocks of the QP are sized once at
+// construction. It runs the Gauss-Newton SQP of
+// MPC::OptimizeRiccati with the model linearized in closed form instead of
+// through an FG_backend. MPC stays the controller with a runtime horizon
+// and all the backends and optimizers.
+template <size_t N>
+class MPC_fixed {
+ public:
+  static_assert(N >= 3, "the rate penalties need at least 3 stages");
+
+  static constexpr size_t n_state = 6;
+  static constexpr size_t n_actuator = 2;
+
+  typedef Eigen::Matrix<double, n_state, 1> State;
+  typedef Eigen::Matrix<double, 4, 1> Coeffs;
+
+  // Outcome of a call of Solve, like MPC_result.
+  struct Result {
+    MPC_result::Status status;
+    int iterations;
+    // the first actuations, followed by the x and y of the N stages
+    std::array<double, 2 + 2 * N> vars;
+  };
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  // The horizon and the steps of `config` are ignored, the horizon is the
+  // template parameter and every step takes the dt of `config`.
+  explicit MPC_fixed(const MPC_config& config = MPC_config()) : qp(N) {
+    dt = config.dt;
+    ref_v = config.ref_v;
+    warm_start = true;
+    max_iterations = 30;
+    feasibility_tol = 1e-6;
+    for (size_t t = 0; t < N - 1; t++) {
+      u[t].setZero();
+    }
+    CostHessian();
+  }
+
+  // Solve the model given an initial state and polynomial coefficients,
+  // stopped at the wall-clock `deadline`.
+  Result Solve(const State& state, const Coeffs& coeffs,
+               std::chrono::steady_clock::time_point deadline) {
+    this->coeffs = coeffs;
+
+    // Start from the last actuations shifted by one step, or from zero.
+    // The states are rolled out, so the start satisfies the model.
+    if (warm_start) {
+      for (size_t t = 0; t + 2 < N; t++) {
+        u[t] = u[t + 1];
+      }
+    } else {
+      for (size_t t = 0; t < N - 1; t++) {
+        u[t].setZero();
+      }
+    }
+    z[0] << state, 0.0, 0.0;
+    for (size_t t = 0; t < N - 1; t++) {
+      z[t + 1] = Step(z[t], u[t]);
+    }
+
+    Result result;
+    result.status = MPC_result::FAILED;
+    int iteration = 0;
+    while (iteration < max_iterations) {
+      iteration++;
+      Linearize(state);
+      if (qp.Solve() < 0) {
+        break;
+      }
+
+      // full step
+      double step = 0.0;
+      double scale = 0.0;
+      for (size_t t = 0; t < N; t++) {
+        z[t] += qp.z[t];
+        step = std::max(step, qp.z[t].cwiseAbs().maxCoeff());
+        scale = std::max(scale, z[t].cwiseAbs().maxCoeff());
+        if (t < N - 1) {
+          u[t] += qp.u[t];
+          step = std::max(step, qp.u[t].cwiseAbs().maxCoeff());
+        }
+      }
+      if (step < 1e-6 * (1.0 + scale)) {
+        result.status = MPC_result::CONVERGED;
+        break;
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        if (Infeasibility(state) <= feasibility_tol) {
+          result.status = MPC_result::TRUNCATED;
+        }
+        break;
+      }
+    }
+    if (result.status == MPC_result::FAILED) {
+      for (size_t t = 0; t < N - 1; t++) {
+        u[t].setZero();
+      }
+    }
+
+    result.iterations = iteration;
+    result.vars[0] = u[0][0];
+    result.vars[1] = u[0][1];
+    for (size_t t = 0; t < N; t++) {
+      result.vars[2 + 2 * t] = z[t][0];
+      result.vars[3 + 2 * t] = z[t][1];
+    }
+    return result;
+  }
+
+  // Seed each solve with the previous actuations shifted by one step.
+  bool warm_start;
+  int max_iterations;
+  // largest model defect of a truncated solution
+  double feasibility_tol;
+
+ private:
+  // The state is augmented with the previous actuation, like in
+  // MPC::OptimizeRiccati.
+  static constexpr int NX = n_state + n_actuator;
+  static constexpr int NU = n_actuator;
+  typedef QP_riccati<NX, NU> QP;
+  typedef typename QP::VectorX Augmented;
+  typedef typename QP::VectorU Control;
+
+  double Path(double x) const {
+    return coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3]));
+  }
+
+  double PathD1(double x) const {
+    return coeffs[1] + x * (2 * coeffs[2] + 3 * coeffs[3] * x);
+  }
+
+  double PathD2(double x) const { return 2 * coeffs[2] + 6 * coeffs[3] * x; }
+
+  // The model of FG_eval, delta is negated for the simulator.
+  Augmented Step(const Augmented& x, const Control& u) const {
+    Augmented next;
+    next[0] = x[0] + x[3] * cos(x[2]) * dt;
+    next[1] = x[1] + x[3] * sin(x[2]) * dt;
+    next[2] = x[2] + x[3] * (-u[0]) / Lf * dt;
+    next[3] = x[3] + u[1] * dt;
+    next[4] = (Path(x[0]) - x[1]) + x[3] * sin(x[5]) * dt;
+    next[5] = (x[2] - atan(PathD1(x[0]))) + x[3] * (-u[0]) / Lf * dt;
+    next.template tail<NU>() = u;
+    return next;
+  }
+
+  // The cost of FG_eval is quadratic in the augmented stages, its Hessian
+  // is placed into the QP once.
+  void CostHessian() {
+    for (size_t t = 0; t < N; t++) {
+      typename QP::Stage& stage = qp.stages[t];
+      stage.Q.setZero();
+      stage.S.setZero();
+      stage.R.setZero();
+      stage.Q(3, 3) = 2 * weight_v;
+      stage.Q(4, 4) = 2 * weight_cte;
+      stage.Q(5, 5) = 2 * weight_epsi;
+      if (t == N - 1) {
+        break;
+      }
+      stage.R(0, 0) = 2 * weight_delta;
+      stage.R(1, 1) = 2 * weight_a;
+      if (t > 0) {
+        // the rate penalties between the actuation and the previous one
+        stage.Q(6, 6) = 2 * weight_delta_diff;
+        stage.Q(7, 7) = 2 * weight_a_diff;
+        stage.R(0, 0) += 2 * weight_delta_diff;
+        stage.R(1, 1) += 2 * weight_a_diff;
+        stage.S(0, 6) = -2 * weight_delta_diff;
+        stage.S(1, 7) = -2 * weight_a_diff;
+      }
+    }
+  }
+
+  // QP of the step from the current trajectory: the model linearized at
+  // each stage, its defects, the cost gradient and the actuator bounds.
+  void Linearize(const State& state) {
+    qp.z0.setZero();
+    qp.z0.template head<n_state>() = state - z[0].template head<n_state>();
+    for (size_t t = 0; t < N; t++) {
+      typename QP::Stage& stage = qp.stages[t];
+      stage.q = stage.Q * z[t];
+      stage.q[3] -= 2 * weight_v * ref_v;
+      if (t == N - 1) {
+        break;
+      }
+      const Augmented& x = z[t];
+      const Control& a = u[t];
+      stage.q += stage.S.transpose() * a;
+      stage.r = stage.R * a + stage.S * x;
+      stage.lb << -delta_max - a[0], -a_max - a[1];
+      stage.ub << delta_max - a[0], a_max - a[1];
+      stage.d = Step(x, a) - z[t + 1];
+
+      double f1 = PathD1(x[0]);
+      stage.A.setZero();
+      stage.A(0, 0) = 1.0;
+      stage.A(0, 2) = -x[3] * sin(x[2]) * dt;
+      stage.A(0, 3) = cos(x[2]) * dt;
+      stage.A(1, 1) = 1.0;
+      stage.A(1, 2) = x[3] * cos(x[2]) * dt;
+      stage.A(1, 3) = sin(x[2]) * dt;
+      stage.A(2, 2) = 1.0;
+      stage.A(2, 3) = -a[0] / Lf * dt;
+      stage.A(3, 3) = 1.0;
+      stage.A(4, 0) = f1;
+      stage.A(4, 1) = -1.0;
+      stage.A(4, 3) = sin(x[5]) * dt;
+      stage.A(4, 5) = x[3] * cos(x[5]) * dt;
+      stage.A(5, 0) = -PathD2(x[0]) / (1 + f1 * f1);
+      stage.A(5, 2) = 1.0;
+      stage.A(5, 3) = -a[0] / Lf * dt;
+
+      stage.B.setZero();
+      stage.B(2, 0) = -x[3] / Lf * dt;
+      stage.B(3, 1) = dt;
+      stage.B(5, 0) = -x[3] / Lf * dt;
+      stage.B(6, 0) = 1.0;
+      stage.B(7, 1) = 1.0;
+    }
+  }
+
+  // Largest defect of the model and of the initial state.
+  double Infeasibility(const State& state) const {
+    double infeasibility =
+        (z[0].template head<n_state>() - state).cwiseAbs().maxCoeff();
+    for (size_t t = 0; t < N - 1; t++) {
+      infeasibility = std::max(
+          infeasibility, (Step(z[t], u[t]) - z[t + 1]).cwiseAbs().maxCoeff());
+    }
+    return infeasibility;
+  }
+
+  double dt;
+  double ref_v;
+  Coeffs coeffs;
+  // current trajectory of the SQP
+  std::array<Augmented, N> z;
+  std::array<Control, N - 1> u;
+  QP qp;
+};
+
+template <size_t N> constexpr size_t MPC_fixed<N>::n_state;
+template <size_t N> constexpr size_t MPC_fixed<N>::n_actuator;
+
+#endif /* MPC_FIXED_H */
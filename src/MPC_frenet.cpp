@@ -0,0 +1,289 @@
+#include "MPC_frenet.h"
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+#include "MPC_model.h"
+
+using namespace std;
+
+// Step lengths of the horizon of `config`.
+static vector<double> Steps(const MPC_config& config) {
+  if (!config.steps.empty()) {
+    return config.steps;
+  }
+  return vector<double>(config.N - 1, config.dt);
+}
+
+MPC_frenet::MPC_frenet(const MPC_config& config)
+    : dt(Steps(config)), coeffs(4), z(dt.size() + 1), u(dt.size()),
+      qp(dt.size() + 1) {
+  N = dt.size() + 1;
+  ref_v = config.ref_v;
+  warm_start = true;
+  max_iterations = 30;
+  feasibility_tol = 1e-6;
+  ds = 0.5;
+  for (size_t t = 0; t < N - 1; t++) {
+    u[t].setZero();
+  }
+  CostHessian();
+}
+
+double MPC_frenet::Path(double x) const {
+  return coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3]));
+}
+
+double MPC_frenet::PathD1(double x) const {
+  return coeffs[1] + x * (2 * coeffs[2] + 3 * coeffs[3] * x);
+}
+
+double MPC_frenet::PathD2(double x) const {
+  return 2 * coeffs[2] + 6 * coeffs[3] * x;
+}
+
+MPC_frenet::Augmented MPC_frenet::Project(double px, double py, double psi,
+                                          double v) {
+  // closest point of the path, Newton on the derivative of the squared
+  // distance
+  double x = px;
+  for (int i = 0; i < 5; i++) {
+    double f = Path(x) - py;
+    double f1 = PathD1(x);
+    double g = (x - px) + f * f1;
+    double h = 1 + f1 * f1 + f * PathD2(x);
+    if (h <= 0) {
+      break;
+    }
+    x -= g / h;
+  }
+
+  // x along the arc length with midpoint steps, far enough for the
+  // horizon at full acceleration. Curvature past the tightest turn of the
+  // vehicle is an artifact of the fit, and near 1 / e_y it makes s'
+  // singular, so it is clamped.
+  double k_max = tan(delta_max) / Lf;
+  double T = accumulate(dt.begin(), dt.end(), 0.0);
+  double reach = T * (max(v, 0.0) + a_max * T) + 20.0;
+  size_t n = (size_t)ceil(reach / ds) + 2;
+  path_x.resize(n);
+  path_k.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    double f1 = PathD1(x);
+    path_x[i] = x;
+    path_k[i] = max(-k_max, min(PathD2(x) / pow(1 + f1 * f1, 1.5), k_max));
+    double mid = x + 0.5 * ds / sqrt(1 + f1 * f1);
+    f1 = PathD1(mid);
+    x += ds / sqrt(1 + f1 * f1);
+  }
+
+  double heading = atan(PathD1(path_x[0]));
+  double e_y = -(px - path_x[0]) * sin(heading) +
+               (py - Path(path_x[0])) * cos(heading);
+  double e_psi = psi - heading;
+  Augmented z0;
+  z0 << 0.0, e_y, atan2(sin(e_psi), cos(e_psi)), v, 0.0, 0.0;
+  return z0;
+}
+
+void MPC_frenet::Lookup(double s, double& x, double& k, double& dk) const {
+  // linear between the entries, x extrapolated and k held past the ends
+  size_t n = path_x.size();
+  double w = s / ds;
+  size_t i = (size_t)min(max(floor(w), 0.0), (double)(n - 2));
+  w -= i;
+  x = path_x[i] + w * (path_x[i + 1] - path_x[i]);
+  if (w < 0.0 || w > 1.0) {
+    k = w < 0.0 ? path_k[i] : path_k[i + 1];
+    dk = 0.0;
+    return;
+  }
+  k = path_k[i] + w * (path_k[i + 1] - path_k[i]);
+  dk = (path_k[i + 1] - path_k[i]) / ds;
+}
+
+// The model in path coordinates, delta is negated for the simulator.
+MPC_frenet::Augmented MPC_frenet::Step(size_t t, const Augmented& z,
+                                       const Control& u) const {
+  double h = dt[t];
+  double x, k, dk;
+  Lookup(z[0], x, k, dk);
+  double s_dot = z[3] * cos(z[2]) / (1 - k * z[1]);
+  Augmented next;
+  next[0] = z[0] + s_dot * h;
+  next[1] = z[1] + z[3] * sin(z[2]) * h;
+  next[2] = z[2] + (z[3] * (-u[0]) / Lf - k * s_dot) * h;
+  next[3] = z[3] + u[1] * h;
+  next.tail<NU>() = u;
+  return next;
+}
+
+void MPC_frenet::Linearize(size_t t, const Augmented& z, const Control& u,
+                           QP::MatrixXX& A, QP::MatrixXU& B) const {
+  double h = dt[t];
+  double x, k, dk;
+  Lookup(z[0], x, k, dk);
+  double c = cos(z[2]);
+  double sn = sin(z[2]);
+  double D = 1 - k * z[1];
+  double s_dot = z[3] * c / D;
+  // derivatives of s' by s, e_y, e_psi and v
+  double s_dot_s = s_dot * z[1] * dk / D;
+  double s_dot_y = s_dot * k / D;
+  double s_dot_psi = -z[3] * sn / D;
+  double s_dot_v = c / D;
+
+  A.setZero();
+  A(0, 0) = 1.0 + s_dot_s * h;
+  A(0, 1) = s_dot_y * h;
+  A(0, 2) = s_dot_psi * h;
+  A(0, 3) = s_dot_v * h;
+  A(1, 1) = 1.0;
+  A(1, 2) = z[3] * c * h;
+  A(1, 3) = sn * h;
+  A(2, 0) = -(dk * s_dot + k * s_dot_s) * h;
+  A(2, 1) = -k * s_dot_y * h;
+  A(2, 2) = 1.0 - k * s_dot_psi * h;
+  A(2, 3) = (-u[0] / Lf - k * s_dot_v) * h;
+  A(3, 3) = 1.0;
+
+  B.setZero();
+  B(2, 0) = -z[3] / Lf * h;
+  B(3, 1) = h;
+  B(4, 0) = 1.0;
+  B(5, 1) = 1.0;
+}
+
+// The cost of FG_eval with e_y and e_psi for cte and epsi, with its own
+// weights of the offset and the steering rate, is quadratic in the augmented
+// stages.
+void MPC_frenet::CostHessian() {
+  for (size_t t = 0; t < N; t++) {
+    QP::Stage& stage = qp.stages[t];
+    stage.Q.setZero();
+    stage.S.setZero();
+    stage.R.setZero();
+    stage.Q(1, 1) = 2 * weight_e_y;
+    stage.Q(2, 2) = 2 * weight_epsi;
+    stage.Q(3, 3) = 2 * weight_v;
+    if (t == N - 1) {
+      break;
+    }
+    stage.R(0, 0) = 2 * weight_delta;
+    stage.R(1, 1) = 2 * weight_a;
+    if (t > 0) {
+      // the rate penalties between the actuation and the previous one
+      double rate = RateFactor(dt, t - 1);
+      stage.Q(4, 4) = 2 * weight_e_y_delta_diff * rate;
+      stage.Q(5, 5) = 2 * weight_a_diff * rate;
+      stage.R(0, 0) += 2 * weight_e_y_delta_diff * rate;
+      stage.R(1, 1) += 2 * weight_a_diff * rate;
+      stage.S(0, 4) = -2 * weight_e_y_delta_diff * rate;
+      stage.S(1, 5) = -2 * weight_a_diff * rate;
+    }
+  }
+}
+
+void MPC_frenet::Linearize(const Augmented& z0) {
+  qp.z0 = z0 - z[0];
+  for (size_t t = 0; t < N; t++) {
+    QP::Stage& stage = qp.stages[t];
+    stage.q = stage.Q * z[t];
+    stage.q[3] -= 2 * weight_v * ref_v;
+    if (t == N - 1) {
+      break;
+    }
+    const Augmented& x = z[t];
+    const Control& a = u[t];
+    stage.q += stage.S.transpose() * a;
+    stage.r = stage.R * a + stage.S * x;
+    stage.lb << -delta_max - a[0], -a_max - a[1];
+    stage.ub << delta_max - a[0], a_max - a[1];
+    stage.d = Step(t, x, a) - z[t + 1];
+    Linearize(t, x, a, stage.A, stage.B);
+  }
+}
+
+double MPC_frenet::Infeasibility(const Augmented& z0) const {
+  double infeasibility = (z[0] - z0).cwiseAbs().maxCoeff();
+  for (size_t t = 0; t < N - 1; t++) {
+    infeasibility = max(infeasibility,
+                        (Step(t, z[t], u[t]) - z[t + 1]).cwiseAbs().maxCoeff());
+  }
+  return infeasibility;
+}
+
+MPC_result MPC_frenet::Plan(const Eigen::VectorXd& state,
+                            const Eigen::VectorXd& coeffs,
+                            chrono::steady_clock::time_point deadline) {
+  this->coeffs = coeffs;
+  Augmented z0 = Project(state[0], state[1], state[2], state[3]);
+
+  // Start from the last actuations shifted by one step, or from zero.
+  // The states are rolled out, so the start satisfies the model.
+  if (warm_start) {
+    for (size_t t = 0; t + 2 < N; t++) {
+      u[t] = u[t + 1];
+    }
+  } else {
+    for (size_t t = 0; t < N - 1; t++) {
+      u[t].setZero();
+    }
+  }
+  z[0] = z0;
+  for (size_t t = 0; t < N - 1; t++) {
+    z[t + 1] = Step(t, z[t], u[t]);
+  }
+
+  MPC_result result;
+  result.status = MPC_result::FAILED;
+  int iteration = 0;
+  while (iteration < max_iterations) {
+    iteration++;
+    Linearize(z0);
+    if (qp.Solve() < 0) {
+      break;
+    }
+
+    // full step
+    double step = 0.0;
+    double scale = 0.0;
+    for (size_t t = 0; t < N; t++) {
+      z[t] += qp.z[t];
+      step = max(step, qp.z[t].cwiseAbs().maxCoeff());
+      scale = max(scale, z[t].cwiseAbs().maxCoeff());
+      if (t < N - 1) {
+        u[t] += qp.u[t];
+        step = max(step, qp.u[t].cwiseAbs().maxCoeff());
+      }
+    }
+    if (step < 1e-6 * (1.0 + scale)) {
+      result.status = MPC_result::CONVERGED;
+      break;
+    }
+    if (chrono::steady_clock::now() >= deadline) {
+      if (Infeasibility(z0) <= feasibility_tol) {
+        result.status = MPC_result::TRUNCATED;
+      }
+      break;
+    }
+  }
+  result.iterations = iteration;
+  if (result.status == MPC_result::FAILED) {
+    for (size_t t = 0; t < N - 1; t++) {
+      u[t].setZero();
+    }
+    return result;
+  }
+
+  // the planned positions, offset by e_y along the normal of the path
+  result.delta = u[0][0];
+  result.a = u[0][1];
+  for (size_t t = 0; t < N; t++) {
+    double x, k, dk;
+    Lookup(z[t][0], x, k, dk);
+    double heading = atan(PathD1(x));
+    result.x.push_back(x - z[t][1] * sin(heading));
+    result.y.push_back(Path(x) + z[t][1] * cos(heading));
+  }
+  return result;
+}
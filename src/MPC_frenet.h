@@ -0,0 +1,101 @@
+#ifndef MPC_FRENET_H
+#define MPC_FRENET_H
+
+#include <chrono>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/StdVector"
+#include "MPC.h"
+#include "QP_riccati.h"
+
+// The problem of MPC in path (Frenet) coordinates.
+//
+// The state of a stage is the arc length s along the fitted path, the
+// lateral offset e_y (positive to the left of the path), the heading error
+// e_psi and the speed v; x, y and psi are not variables, and neither are
+// cte and epsi, which e_y and e_psi replace. With the kinematic model of
+// FG_eval and the curvature k(s) of the path:
+//   s' = v cos(e_psi) / (1 - k e_y)
+//   e_y' = v sin(e_psi)
+//   e_psi' = v (-delta) / Lf - k s'
+//   v' = a
+// The curvature is tabulated over the arc length from the coefficients
+// once per solve, starting at the point of the path closest to the
+// vehicle (s = 0). The cost is the one of FG_eval with e_y and e_psi in
+// place of cte and epsi; the offset is exact here, and its weight and the
+// one of the steering rate are tuned apart (see MPC_model.h).
+//
+// Like MPC_fixed it runs the Gauss-Newton SQP of MPC::OptimizeRiccati with
+// the model linearized in closed form, here with a state of four instead of
+// six. The planned x and y are rebuilt from the path for the result.
+class MPC_frenet : public Controller {
+ public:
+  // The horizon, steps and reference speed of `config` are used.
+  explicit MPC_frenet(const MPC_config& config = MPC_config());
+
+  // Seed each solve with the previous actuations shifted by one step.
+  bool warm_start;
+  int max_iterations;
+  // largest model defect of a truncated solution
+  double feasibility_tol;
+
+ protected:
+  // Solve the model given an initial state (x, y, psi, v, cte, epsi) in the
+  // vehicle frame and the polynomial coefficients, stopped at the
+  // wall-clock `deadline`.
+  MPC_result Plan(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  std::chrono::steady_clock::time_point deadline);
+
+ private:
+  // The state is augmented with the previous actuation for the rate
+  // penalties, like in MPC::OptimizeRiccati.
+  static const int n_state = 4;
+  static const int NX = n_state + 2;
+  static const int NU = 2;
+  typedef QP_riccati<NX, NU> QP;
+  typedef QP::VectorX Augmented;
+  typedef QP::VectorU Control;
+
+  // Path f(x) of the coefficients and its derivatives.
+  double Path(double x) const;
+  double PathD1(double x) const;
+  double PathD2(double x) const;
+
+  // Tabulate x and the curvature over the arc length from the point of the
+  // path closest to (px, py), and return the Frenet state there.
+  Augmented Project(double px, double py, double psi, double v);
+
+  // x of the path and the curvature and its derivative at arc length s.
+  void Lookup(double s, double& x, double& k, double& dk) const;
+
+  // Model step t and its Jacobians.
+  Augmented Step(size_t t, const Augmented& z, const Control& u) const;
+  void Linearize(size_t t, const Augmented& z, const Control& u,
+                 QP::MatrixXX& A, QP::MatrixXU& B) const;
+
+  // The cost Hessian, placed into the QP once.
+  void CostHessian();
+
+  // QP of the step from the current trajectory.
+  void Linearize(const Augmented& z0);
+
+  // Largest defect of the model and of the initial state.
+  double Infeasibility(const Augmented& z0) const;
+
+  size_t N;
+  std::vector<double> dt;
+  double ref_v;
+  Eigen::VectorXd coeffs;
+
+  // x and curvature of the path every `ds` of arc length
+  double ds;
+  std::vector<double> path_x;
+  std::vector<double> path_k;
+
+  // current trajectory of the SQP
+  std::vector<Augmented, Eigen::aligned_allocator<Augmented> > z;
+  std::vector<Control, Eigen::aligned_allocator<Control> > u;
+  QP qp;
+};
+
+#endif /* MPC_FRENET_H */
@@ -0,0 +1,94 @@
+#ifndef MPC_INTEGRATOR_H
+#define MPC_INTEGRATOR_H
+
+#include <math.h>
+#include <algorithm>
+#include "MPC_model.h"
+
+// Integration of the kinematic model over one step of the horizon, with the
+// actuation held.
+//
+// Within a step the state z = (x, y, psi, v, cte, epsi) follows
+//   x' = v cos(psi)
+//   y' = v sin(psi)
+//   psi' = v (-delta) / Lf
+//   v' = a
+//   cte' = v sin(epsi)
+//   epsi' = v (-delta) / Lf
+// from cte = f(x) - y and epsi = psi - psides at the start of the step.
+// A single EULER step is the original model of FG_eval. Several substeps
+// or the higher orders keep the prediction accurate over longer steps, so
+// the same preview takes fewer stages.
+//
+// Written for any scalar type like FG_eval.
+struct MPC_integrator {
+  enum Method {
+    // explicit Euler
+    EULER,
+    // explicit midpoint, second order
+    RK2,
+    // classical Runge-Kutta, fourth order
+    RK4
+  };
+  Method method;
+  // steps of `method` per step of the horizon
+  int substeps;
+
+  MPC_integrator(Method method = EULER, int substeps = 1)
+      : method(method), substeps(std::max(substeps, 1)) {}
+
+  // Whether it is the single Euler step of the original model, the one of
+  // FG_analytic and of the generated kernels.
+  bool Euler() const { return method == EULER && substeps == 1; }
+
+  // Advance `z` by the step length h.
+  template <class Scalar>
+  void Step(Scalar z[6], const Scalar& delta, const Scalar& a,
+            double h) const {
+    double hs = h / substeps;
+    Scalar k1[6], k2[6], k3[6], k4[6], m[6];
+    for (int i = 0; i < substeps; i++) {
+      Rate(z, delta, a, k1);
+      if (method == EULER) {
+        Add(z, k1, hs, z);
+      } else if (method == RK2) {
+        Add(z, k1, hs / 2, m);
+        Rate(m, delta, a, k2);
+        Add(z, k2, hs, z);
+      } else {
+        Add(z, k1, hs / 2, m);
+        Rate(m, delta, a, k2);
+        Add(z, k2, hs / 2, m);
+        Rate(m, delta, a, k3);
+        Add(z, k3, hs, m);
+        Rate(m, delta, a, k4);
+        for (int j = 0; j < 6; j++) {
+          z[j] = z[j] + (k1[j] + 2 * k2[j] + 2 * k3[j] + k4[j]) * (hs / 6);
+        }
+      }
+    }
+  }
+
+  // Time derivative of z, delta is negated for the simulator.
+  template <class Scalar>
+  static void Rate(const Scalar z[6], const Scalar& delta, const Scalar& a,
+                   Scalar dz[6]) {
+    dz[0] = z[3] * cos(z[2]);
+    dz[1] = z[3] * sin(z[2]);
+    dz[2] = z[3] * (-delta) / Lf;
+    dz[3] = a;
+    dz[4] = z[3] * sin(z[5]);
+    dz[5] = dz[2];
+  }
+
+  // out = z + h dz, `out` may be `z`
+  template <class Scalar>
+  static void Add(const Scalar z[6], const Scalar dz[6], double h,
+                  Scalar out[6]) {
+    for (int j = 0; j < 6; j++) {
+      out[j] = z[j] + dz[j] * h;
+    }
+  }
+};
+
+#endif /* MPC_INTEGRATOR_H */
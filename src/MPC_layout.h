@@ -0,0 +1,171 @@
+#ifndef MPC_LAYOUT_H
+#define MPC_LAYOUT_H
+
+#include <assert.h>
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Position of the variables and of the constraint rows of the MPC problem.
+//
+// VARIABLE_MAJOR is the original layout: a block per variable over the
+// stages, x0 .. x(N-1), y0 .., then delta0 .. delta(N-2) and a0 ..; the
+// constraint rows share the layout of the states. STAGE_MAJOR interleaves
+// the stages, [x0 y0 psi0 v0 cte0 epsi0 delta0 a0 | x1 ...], with the six
+// constraint rows of each stage in the same order. The couplings of a stage
+// then sit next to each other, and the KKT matrix is banded with a
+// bandwidth independent of N.
+//
+// With move blocking the actuation is held over blocks of steps and there
+// is one actuator variable per block. In STAGE_MAJOR it follows the states
+// of the first stage of its block.
+struct MPC_layout {
+  enum Order { VARIABLE_MAJOR, STAGE_MAJOR };
+
+  // states and actuators of a stage
+  enum { X, Y, PSI, V, CTE, EPSI };
+  enum { DELTA, A };
+  static const size_t n_state = 6;
+  static const size_t n_actuator = 2;
+  static const size_t n_stage = n_state + n_actuator;
+
+  // `blocks` are the lengths of the move blocks from the first step on,
+  // the last length repeats until the N - 1 steps are covered. Empty, every
+  // step has its own actuation. The horizon has at least one step, N >= 2.
+  MPC_layout(size_t N, Order order = VARIABLE_MAJOR,
+             const std::vector<size_t>& blocks = std::vector<size_t>()) {
+    assert(N >= 2);
+    this->N = N;
+    this->order = order;
+    size_t length = 1;
+    for (size_t t = 0; t < N - 1; t++) {
+      if (block_start.empty() || t - block_start.back() == length) {
+        size_t b = block_start.size();
+        length = blocks.empty() ? 1 : blocks[std::min(b, blocks.size() - 1)];
+        length = std::max(length, (size_t)1);
+        block_start.push_back(t);
+      }
+      block.push_back(block_start.size() - 1);
+    }
+    n_blocks = block_start.size();
+    n_vars = n_state * N + n_actuator * n_blocks;
+    n_constraints = n_state * N;
+  }
+
+  // Whether some actuation is held over more than one step.
+  bool Blocked() const { return n_blocks + 1 != N; }
+
+  // Variable of state i (X .. EPSI) of stage t.
+  size_t State(size_t i, size_t t) const {
+    if (order == STAGE_MAJOR) {
+      // the actuators of the blocks started before stage t come first
+      return t * n_state + (t == 0 ? 0 : n_actuator * (block[t - 1] + 1)) + i;
+    }
+    return i * N + t;
+  }
+
+  // Variable of actuator j (DELTA, A) of stage t < N - 1, shared by the
+  // stages of its move block.
+  size_t Actuator(size_t j, size_t t) const {
+    if (order == STAGE_MAJOR) {
+      return State(0, block_start[block[t]]) + n_state + j;
+    }
+    return n_state * N + j * n_blocks + block[t];
+  }
+
+  // Constraint row of state i of stage t, the rows of stage 0 fix the
+  // initial state.
+  size_t Row(size_t i, size_t t) const {
+    return order == STAGE_MAJOR ? t * n_state + i : i * N + t;
+  }
+
+  // Positions of the quantities of one stage.
+  struct Stage {
+    size_t x, y, psi, v, cte, epsi;
+    size_t delta, a;
+  };
+
+  // Variables of stage t, delta and a only for t < N - 1.
+  Stage Vars(size_t t) const {
+    Stage s;
+    s.x = State(X, t);
+    s.y = State(Y, t);
+    s.psi = State(PSI, t);
+    s.v = State(V, t);
+    s.cte = State(CTE, t);
+    s.epsi = State(EPSI, t);
+    s.delta = t + 1 < N ? Actuator(DELTA, t) : n_vars;
+    s.a = t + 1 < N ? Actuator(A, t) : n_vars;
+    return s;
+  }
+
+  // Constraint rows of stage t, delta and a have none.
+  Stage Rows(size_t t) const {
+    Stage s;
+    s.x = Row(X, t);
+    s.y = Row(Y, t);
+    s.psi = Row(PSI, t);
+    s.v = Row(V, t);
+    s.cte = Row(CTE, t);
+    s.epsi = Row(EPSI, t);
+    s.delta = n_constraints;
+    s.a = n_constraints;
+    return s;
+  }
+
+  // Stage `t` and index `i` in the state or the actuation of variable
+  // `var`, the first stage of the block for an actuator. Returns true for
+  // the actuators.
+  bool Locate(size_t var, size_t& t, size_t& i) const {
+    if (order == STAGE_MAJOR) {
+      // the stages before t take n_state to n_stage variables each
+      size_t lo = var / n_stage;
+      size_t hi = std::min(var / n_state, N - 1);
+      while (lo < hi) {
+        size_t mid = (lo + hi + 1) / 2;
+        if (State(0, mid) <= var) {
+          lo = mid;
+        } else {
+          hi = mid - 1;
+        }
+      }
+      t = lo;
+      i = var - State(0, t);
+      if (i < n_state) {
+        return false;
+      }
+      i -= n_state;
+      return true;
+    }
+    if (var < n_state * N) {
+      t = var % N;
+      i = var / N;
+      return false;
+    }
+    t = block_start[(var - n_state * N) % n_blocks];
+    i = (var - n_state * N) / n_blocks;
+    return true;
+  }
+
+  // Stage `t` and state `i` of constraint row `row`.
+  void LocateRow(size_t row, size_t& t, size_t& i) const {
+    if (order == STAGE_MAJOR) {
+      t = row / n_state;
+      i = row % n_state;
+    } else {
+      t = row % N;
+      i = row / N;
+    }
+  }
+
+  size_t N;
+  Order order;
+  // move block of each step t < N - 1, and the first step of each block
+  std::vector<size_t> block;
+  std::vector<size_t> block_start;
+  size_t n_blocks;
+  size_t n_vars;
+  size_t n_constraints;
+};
+
+#endif /* MPC_LAYOUT_H */
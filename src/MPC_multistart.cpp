@@ -0,0 +1,112 @@
+#include "MPC_multistart.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+using namespace std;
+
+MPC_multistart::MPC_multistart(const MPC_config& config,
+                               MPC::Derivatives derivatives,
+                               const vector<MPC::Start>& starts) {
+  for (MPC::Start start : starts) {
+    controllers.emplace_back(new MPC(config, derivatives));
+    controllers.back()->start = start;
+  }
+  pool.reset(new Eigen::NonBlockingThreadPool(starts.size()));
+  wins.assign(starts.size(), 0);
+  cancelled = 0;
+  patience = 1.0;
+}
+
+void MPC_multistart::SetOptimizer(MPC::Optimizer optimizer) {
+  for (auto& mpc : controllers) {
+    mpc->optimizer = optimizer;
+  }
+}
+
+void MPC_multistart::SetFrame(double px, double py, double psi) {
+  for (auto& mpc : controllers) {
+    mpc->SetFrame(px, py, psi);
+  }
+}
+
+MPC_result MPC_multistart::Plan(const Eigen::VectorXd& state,
+                                const Eigen::VectorXd& coeffs,
+                                chrono::steady_clock::time_point deadline) {
+  size_t K = controllers.size();
+  vector<MPC_result> results(K);
+  vector<double> costs(K);
+  vector<bool> finished(K, false);
+  for (auto& mpc : controllers) {
+    mpc->Cancel(false);
+  }
+
+  // solve all starts on the pool, the first converged one sets the cutoff
+  mutex m;
+  condition_variable done;
+  size_t pending = K;
+  auto begin = chrono::steady_clock::now();
+  auto cutoff = deadline;
+  for (size_t i = 0; i < K; i++) {
+    pool->Schedule([&, i]() {
+      MPC_result result = controllers[i]->Solve(state, coeffs, deadline);
+      double cost = controllers[i]->Cost();
+      auto now = chrono::steady_clock::now();
+      lock_guard<mutex> lock(m);
+      results[i] = result;
+      costs[i] = cost;
+      finished[i] = true;
+      if (result.status == MPC_result::CONVERGED) {
+        auto spare = chrono::duration_cast<chrono::steady_clock::duration>(
+            patience * (now - begin));
+        cutoff = min(cutoff, now + spare);
+      }
+      pending--;
+      done.notify_one();
+    });
+  }
+
+  // cancel the starts still running at the cutoff and wait for all
+  unique_lock<mutex> lock(m);
+  bool stopped = false;
+  while (pending > 0) {
+    if (!stopped && chrono::steady_clock::now() >= cutoff) {
+      for (size_t i = 0; i < K; i++) {
+        if (!finished[i]) {
+          controllers[i]->Cancel();
+          cancelled++;
+        }
+      }
+      stopped = true;
+    }
+    if (stopped) {
+      done.wait(lock);
+    } else {
+      done.wait_until(lock, cutoff);
+    }
+  }
+
+  // the converged plan of the lowest cost, else the truncated one
+  int best = -1;
+  for (MPC_result::Status status :
+       {MPC_result::CONVERGED, MPC_result::TRUNCATED}) {
+    for (size_t i = 0; i < K; i++) {
+      if (results[i].status == status && (best < 0 || costs[i] < costs[best])) {
+        best = i;
+      }
+    }
+    if (best >= 0) {
+      break;
+    }
+  }
+  if (best < 0) {
+    return results[0];
+  }
+  wins[best]++;
+  for (size_t i = 0; i < K; i++) {
+    if ((int)i != best && controllers[i]->start == MPC::SHIFTED) {
+      controllers[i]->CopySolution(*controllers[best]);
+    }
+  }
+  return results[best];
+}
@@ -0,0 +1,64 @@
+#ifndef MPC_MULTISTART_H
+#define MPC_MULTISTART_H
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "MPC.h"
+
+// Controller that solves every tick from several initial guesses at once
+// and keeps the best plan, against the poor local minima a single solve
+// can land in at sharp turns (the "abnormal MPC prediction" of the tuning
+// notes in MPC_model.h).
+//
+// Every start is an MPC object of the same problem with its own
+// MPC::start, solving on a thread of a pool of one per start. Of the
+// converged plans the one of the lowest cost wins, else the truncated one
+// of the lowest cost. The first start to converge sets a cutoff: the
+// others get `patience` times its solve time more and are cancelled then,
+// so a tick takes at most (1 + patience) times the fastest converged start.
+// The winner's plan is handed to the SHIFTED start for its next warm start.
+//
+// The starts only run in parallel with the SQP optimizers and iLQR. Ipopt
+// solves take turns (see MPC): queued behind the first start, the others
+// would be cancelled before they ran, so MPC_registry rejects Ipopt. MPPI
+// samples around its own last plan and is left out as well.
+class MPC_multistart : public Controller {
+ public:
+  // One MPC of `config` per start.
+  MPC_multistart(const MPC_config& config,
+                 MPC::Derivatives derivatives = MPC::ANALYTIC,
+                 const std::vector<MPC::Start>& starts = {
+                     MPC::SHIFTED, MPC::ZERO, MPC::ARC, MPC::PURSUIT});
+
+  // Optimizer of all starts, see MPC::optimizer.
+  void SetOptimizer(MPC::Optimizer optimizer);
+
+  // See MPC::SetFrame.
+  void SetFrame(double px, double py, double psi);
+
+  // time the other starts get after the first converged one, relative to
+  // its solve time
+  double patience;
+
+  // number of wins of each start, and of starts cancelled at the cutoff
+  std::vector<int> wins;
+  int cancelled;
+
+  // Number of starts and the initial guess of each.
+  size_t Starts() const { return controllers.size(); }
+  MPC::Start Start(size_t i) const { return controllers[i]->start; }
+
+ protected:
+  // Solve from all starts and return the best plan.
+  MPC_result Plan(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  std::chrono::steady_clock::time_point deadline);
+
+ private:
+  std::vector<std::unique_ptr<MPC> > controllers;
+  std::unique_ptr<Eigen::NonBlockingThreadPool> pool;
+};
+
+#endif /* MPC_MULTISTART_H */
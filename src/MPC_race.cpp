@@ -0,0 +1,122 @@
+#include "MPC_race.h"
+
+using namespace std;
+
+MPC_race::MPC_race(unique_ptr<Controller> primary,
+                   unique_ptr<Controller> fallback)
+    : primary(move(primary)), fallback(move(fallback)) {
+  accept_truncated = false;
+  margin = chrono::microseconds(200);
+  ticks = 0;
+  fallbacks = 0;
+  failed = 0;
+  late = 0;
+  busy = 0;
+  pending = false;
+  solving = false;
+  stop = false;
+  frame = false;
+  px = py = psi = 0.0;
+  posted_tick = 0;
+  solved_tick = 0;
+  worker = thread(&MPC_race::Work, this);
+}
+
+MPC_race::~MPC_race() {
+  {
+    lock_guard<mutex> lock(guard);
+    stop = true;
+  }
+  posted.notify_one();
+  worker.join();
+}
+
+void MPC_race::SetFrame(double px, double py, double psi) {
+  fallback->SetFrame(px, py, psi);
+  lock_guard<mutex> lock(guard);
+  frame = true;
+  this->px = px;
+  this->py = py;
+  this->psi = psi;
+}
+
+void MPC_race::Prepare(const Eigen::VectorXd& coeffs) {
+  // only this thread posts, the primary stays idle until the next Plan;
+  // a solve of an earlier tick has the frame and the path of that tick
+  {
+    lock_guard<mutex> lock(guard);
+    if (pending || solving || solved_tick != ticks) {
+      return;
+    }
+  }
+  primary->Prepare(coeffs);
+}
+
+MPC_result MPC_race::Plan(const Eigen::VectorXd& state,
+                          const Eigen::VectorXd& coeffs,
+                          chrono::steady_clock::time_point deadline) {
+  ticks++;
+  bool racing = false;
+  {
+    lock_guard<mutex> lock(guard);
+    if (!pending && !solving) {
+      this->state = state;
+      this->coeffs = coeffs;
+      this->deadline = deadline - margin;
+      posted_tick = ticks;
+      pending = true;
+      racing = true;
+    }
+  }
+  if (racing) {
+    posted.notify_one();
+  }
+
+  MPC_result answer = fallback->Solve(state, coeffs, deadline);
+
+  unique_lock<mutex> lock(guard);
+  if (!racing) {
+    busy++;
+  } else if (!solved.wait_until(lock, deadline,
+                                [this] { return solved_tick == ticks; })) {
+    late++;
+  } else if (plan.status == MPC_result::CONVERGED ||
+             (accept_truncated && plan.status == MPC_result::TRUNCATED)) {
+    return plan;
+  } else {
+    failed++;
+  }
+  fallbacks++;
+  return answer;
+}
+
+void MPC_race::Work() {
+  unique_lock<mutex> lock(guard);
+  while (true) {
+    posted.wait(lock, [this] { return pending || stop; });
+    if (stop) {
+      return;
+    }
+    pending = false;
+    solving = true;
+    Eigen::VectorXd x0 = state;
+    Eigen::VectorXd path = coeffs;
+    chrono::steady_clock::time_point until = deadline;
+    bool move_frame = frame;
+    double frame_x = px, frame_y = py, frame_psi = psi;
+    int tick = posted_tick;
+    frame = false;
+    lock.unlock();
+
+    if (move_frame) {
+      primary->SetFrame(frame_x, frame_y, frame_psi);
+    }
+    MPC_result result = primary->Solve(x0, path, until);
+
+    lock.lock();
+    plan = result;
+    solved_tick = tick;
+    solving = false;
+    solved.notify_all();
+  }
+}
@@ -0,0 +1,91 @@
+#ifndef MPC_RACE_H
+#define MPC_RACE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "Eigen-3.3/Eigen/Core"
+#include "Controller.h"
+
+// Controller that races a primary controller against a cheap fallback, e.g.
+// MPC against Pure_pursuit, so that an answer is there by the deadline
+// whatever the solver does.
+//
+// The primary solves on a worker thread of its own while the fallback
+// answers on the calling one. The primary is stopped `margin` before the
+// deadline, which leaves it the margin to hand its plan over, and Solve
+// waits for it until the deadline. Its plan is taken if it converged (or,
+// with accept_truncated, was stopped early with a feasible plan), the
+// fallback's otherwise. A primary that overruns the deadline keeps solving in the
+// background; its late plan is dropped, and the fallback answers every
+// tick until it is done. The worker is one thread for the lifetime of the
+// object, so the per-thread state of CppAD is set up once.
+//
+// Solve returns by the deadline plus the time of the fallback however long
+// the primary takes.
+class MPC_race : public Controller {
+ public:
+  // Race `primary` against `fallback`, owning both.
+  MPC_race(std::unique_ptr<Controller> primary,
+           std::unique_ptr<Controller> fallback);
+  // Waits for a solve of the primary still running.
+  ~MPC_race();
+
+  // Passed on to the fallback, and to the primary with its next solve.
+  void SetFrame(double px, double py, double psi);
+
+  // Passed on to the primary when it is idle and its last solve was of the
+  // last tick.
+  void Prepare(const Eigen::VectorXd& coeffs);
+
+  // take a plan of the primary stopped before it converged, off by default
+  bool accept_truncated;
+  // time between the deadline of the primary and the one of Solve
+  std::chrono::microseconds margin;
+
+  // Ticks, and the ones answered by the fallback: because the plan of the
+  // primary was not usable (failed, or truncated without accept_truncated),
+  // because it missed the deadline, or because it was still busy with the
+  // solve of an earlier tick.
+  int ticks;
+  int fallbacks;
+  int failed;
+  int late;
+  int busy;
+
+ protected:
+  // The plan of the primary if it is there by `deadline` and usable, that
+  // of the fallback otherwise.
+  MPC_result Plan(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  std::chrono::steady_clock::time_point deadline);
+
+ private:
+  // Loop of the worker thread, solving the posted problems.
+  void Work();
+
+  std::unique_ptr<Controller> primary;
+  std::unique_ptr<Controller> fallback;
+
+  // the problem posted to the worker and its plan, under `guard`
+  std::mutex guard;
+  std::condition_variable posted;
+  std::condition_variable solved;
+  bool pending;
+  bool solving;
+  bool stop;
+  Eigen::VectorXd state;
+  Eigen::VectorXd coeffs;
+  std::chrono::steady_clock::time_point deadline;
+  bool frame;
+  double px, py, psi;
+  MPC_result plan;
+  // tick of the posted problem and of the last plan
+  int posted_tick;
+  int solved_tick;
+
+  std::thread worker;
+};
+
+#endif /* MPC_RACE_H */
@@ -0,0 +1,189 @@
+#include "MPC_registry.h"
+#include "MPC_adaptive.h"
+#include "MPC_fixed.h"
+#include "MPC_frenet.h"
+#include "MPC_multistart.h"
+#include "Pure_pursuit.h"
+
+using namespace std;
+
+// MPC_fixed with the horizon of MPC_model.h, its result copied into an
+// MPC_result.
+class MPC_fixed_controller : public Controller {
+ public:
+  explicit MPC_fixed_controller(const MPC_config& config) : fixed(config) {}
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ protected:
+  MPC_result Plan(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  chrono::steady_clock::time_point deadline) {
+    MPC_fixed<N>::Result solution = fixed.Solve(state, coeffs, deadline);
+    MPC_result result;
+    result.status = solution.status;
+    result.iterations = solution.iterations;
+    if (result.status == MPC_result::FAILED) {
+      return result;
+    }
+    result.delta = solution.vars[0];
+    result.a = solution.vars[1];
+    for (size_t t = 0; t < N; t++) {
+      result.x.push_back(solution.vars[2 + 2 * t]);
+      result.y.push_back(solution.vars[3 + 2 * t]);
+    }
+    return result;
+  }
+
+ private:
+  MPC_fixed<N> fixed;
+};
+
+// Backends with their own model and solver only solve the plain problem,
+// none of the options of MPC applies to them.
+static bool PlainProblem(const string& name, const MPC_options& options,
+                         string& error) {
+  const MPC_config& config = options.config;
+  if (options.real_time_iteration || options.adaptive || options.multistart ||
+      !config.blocks.empty() || !config.integrator.Euler()) {
+    error = name + " has its own model and solver, without the real-time "
+                   "iteration, the adaptive horizon, multiple starts, move "
+                   "blocks or another integrator";
+    return false;
+  }
+  if (config.layout != MPC_layout::VARIABLE_MAJOR ||
+      config.linear_solver != MPC_config::MUMPS ||
+      config.hessian != MPC_config::EXACT ||
+      options.derivatives != MPC::GENERATED) {
+    error = name + " has its own model and solver, without another layout, "
+                   "linear solver, Hessian or source of derivatives";
+    return false;
+  }
+  return true;
+}
+
+// Factory of MPC with `optimizer`.
+static MPC_registry::Factory Optimizer(const string& name,
+                                       MPC::Optimizer optimizer) {
+  return [name, optimizer](const MPC_options& options,
+                           string& error) -> Controller* {
+    const MPC_config& config = options.config;
+    if (!config.blocks.empty() && optimizer != MPC::IPOPT &&
+        optimizer != MPC::ADMM) {
+      error = "move blocks need ipopt or admm";
+      return nullptr;
+    }
+    if (!config.integrator.Euler() &&
+        (optimizer == MPC::ILQR || optimizer == MPC::MPPI)) {
+      error = name + " has its own Euler model, without another integrator";
+      return nullptr;
+    }
+    if (options.multistart) {
+      if (options.real_time_iteration || options.adaptive ||
+          optimizer == MPC::IPOPT || optimizer == MPC::MPPI) {
+        error = "multiple starts solve in parallel with riccati, admm or "
+                "ilqr, without the real-time iteration or the adaptive "
+                "horizon";
+        return nullptr;
+      }
+      MPC_multistart* multistart =
+          new MPC_multistart(config, options.derivatives);
+      multistart->SetOptimizer(optimizer);
+      return multistart;
+    }
+    if (options.adaptive) {
+      if (options.real_time_iteration || !config.steps.empty()) {
+        error = "the adaptive horizon is chosen without the real-time "
+                "iteration or step lengths";
+        return nullptr;
+      }
+      MPC_adaptive* adaptive = new MPC_adaptive(
+          MPC_adaptive::Horizons(config, {8, 10, 12, 15, 20}),
+          options.derivatives);
+      adaptive->SetOptimizer(optimizer);
+      return adaptive;
+    }
+    MPC* mpc = new MPC(config, options.derivatives);
+    mpc->optimizer = optimizer;
+    mpc->real_time_iteration = options.real_time_iteration;
+    return mpc;
+  };
+}
+
+vector<MPC_registry::Entry>& MPC_registry::Entries() {
+  static vector<Entry> entries = {
+      {"ipopt", "Ipopt on the sparse problem", Optimizer("ipopt", MPC::IPOPT)},
+      {"riccati", "SQP with Riccati QP steps on the stage structure",
+       Optimizer("riccati", MPC::RICCATI)},
+      {"admm", "SQP with ADMM QP steps on a cached factorization",
+       Optimizer("admm", MPC::ADMM)},
+      {"ilqr", "iterative LQR (box-DDP) on the actuations",
+       Optimizer("ilqr", MPC::ILQR)},
+      {"mppi", "sampling-based path integral control",
+       Optimizer("mppi", MPC::MPPI)},
+      {"frenet", "Riccati SQP of the problem in path coordinates",
+       [](const MPC_options& options, string& error) -> Controller* {
+         if (!PlainProblem("frenet", options, error)) {
+           return nullptr;
+         }
+         return new MPC_frenet(options.config);
+       }},
+      {"fixed", "Riccati SQP with the horizon fixed at compile time",
+       [](const MPC_options& options, string& error) -> Controller* {
+         if (!PlainProblem("fixed", options, error)) {
+           return nullptr;
+         }
+         if (options.config.N != N || !options.config.steps.empty()) {
+           error = "fixed only solves the horizon of MPC_model.h, N = " +
+                   to_string(N);
+           return nullptr;
+         }
+         return new MPC_fixed_controller(options.config);
+       }},
+      {"pursuit", "pure pursuit on the path, no optimization",
+       [](const MPC_options& options, string& error) -> Controller* {
+         if (!PlainProblem("pursuit", options, error)) {
+           return nullptr;
+         }
+         return new Pure_pursuit(options.config);
+       }}};
+  return entries;
+}
+
+void MPC_registry::Add(const string& name, const string& summary,
+                       Factory factory) {
+  vector<Entry>& entries = Entries();
+  for (Entry& entry : entries) {
+    if (entry.name == name) {
+      entry.summary = summary;
+      entry.factory = factory;
+      return;
+    }
+  }
+  entries.push_back({name, summary, factory});
+}
+
+unique_ptr<Controller> MPC_registry::Make(const string& name,
+                                          const MPC_options& options,
+                                          string& error) {
+  // the rate penalties need at least two steps
+  const MPC_config& config = options.config;
+  if (config.steps.empty() ? config.N < 3 : config.steps.size() < 2) {
+    error = "the horizon needs at least two steps";
+    return unique_ptr<Controller>();
+  }
+  for (const Entry& entry : Entries()) {
+    if (entry.name == name) {
+      return unique_ptr<Controller>(entry.factory(options, error));
+    }
+  }
+  error = "unknown backend " + name;
+  return unique_ptr<Controller>();
+}
+
+vector<pair<string, string> > MPC_registry::Backends() {
+  vector<pair<string, string> > backends;
+  for (const Entry& entry : Entries()) {
+    backends.push_back(make_pair(entry.name, entry.summary));
+  }
+  return backends;
+}
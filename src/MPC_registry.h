@@ -0,0 +1,68 @@
+#ifndef MPC_REGISTRY_H
+#define MPC_REGISTRY_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Controller.h"
+#include "MPC.h"
+
+// What a backend is asked for: the problem, where its derivatives come
+// from and how the solves are driven.
+struct MPC_options {
+  MPC_options()
+      : derivatives(MPC::GENERATED), real_time_iteration(false),
+        adaptive(false), multistart(false) {}
+
+  MPC_config config;
+  MPC::Derivatives derivatives;
+  // one SQP step per tick, see MPC::real_time_iteration
+  bool real_time_iteration;
+  // the horizon of every tick among N = 8, 10, 12, 15 and 20 at the dt of
+  // the config, see MPC_adaptive
+  bool adaptive;
+  // every tick from several initial guesses at once, see MPC_multistart
+  bool multistart;
+};
+
+// Controllers selectable by name, e.g. by --backend of main.cpp. The
+// optimizers of MPC are registered as "ipopt", "riccati", "admm", "ilqr"
+// and "mppi", followed by "frenet" (MPC_frenet), "fixed" (MPC_fixed with
+// the horizon of MPC_model.h) and "pursuit" (Pure_pursuit), which reject
+// the options of MPC. Another solver only has to implement Controller and
+// be added here before the controllers are made.
+class MPC_registry {
+ public:
+  // Make the controller for `options`, or return null with the reason in
+  // `error` when the backend cannot solve them.
+  typedef std::function<Controller*(const MPC_options& options,
+                                    std::string& error)> Factory;
+
+  // Add the backend `name` with a one-line `summary`, replacing any of the
+  // same name.
+  static void Add(const std::string& name, const std::string& summary,
+                  Factory factory);
+
+  // Controller of backend `name` for `options`, null with the reason in
+  // `error` for an unknown name or options the backend cannot solve.
+  static std::unique_ptr<Controller> Make(const std::string& name,
+                                          const MPC_options& options,
+                                          std::string& error);
+
+  // Names and summaries of the backends, in the order they were added.
+  static std::vector<std::pair<std::string, std::string> > Backends();
+
+ private:
+  struct Entry {
+    std::string name;
+    std::string summary;
+    Factory factory;
+  };
+
+  // the backends, the built-in ones added on first use
+  static std::vector<Entry>& Entries();
+};
+
+#endif /* MPC_REGISTRY_H */
@@ -0,0 +1,226 @@
+#include "MPC_table.h"
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include "MPC_model.h"
+
+using namespace std;
+
+static const char magic[8] = "MPCTBL2";
+
+MPC_table::MPC_table() {
+  max_spread_delta = 0.05;
+  max_spread_a = 0.5;
+  map = NULL;
+  map_size = 0;
+  header = NULL;
+  values = NULL;
+}
+
+MPC_table::~MPC_table() { Close(); }
+
+void MPC_table::Close() {
+  if (map) {
+    munmap(map, map_size);
+  }
+  map = NULL;
+  header = NULL;
+  values = NULL;
+}
+
+MPC_table::Problem MPC_table::ProblemOf(const MPC_config& config,
+                                        double latency) {
+  Problem problem;
+  problem.N = config.N;
+  problem.dt = config.dt;
+  problem.ref_v = config.ref_v;
+  problem.latency = latency;
+  double weights[7] = {weight_cte,   weight_epsi,       weight_v,
+                       weight_delta, weight_a,          weight_delta_diff,
+                       weight_a_diff};
+  memcpy(problem.weights, weights, sizeof(weights));
+  problem.delta_max = delta_max;
+  problem.a_max = a_max;
+  problem.Lf = Lf;
+  return problem;
+}
+
+bool MPC_table::Open(const string& path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+    close(fd);
+    return false;
+  }
+  map_size = st.st_size;
+  map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    map = NULL;
+    return false;
+  }
+
+  // the size has to match the grid in the header, and the values per point
+  // are delta and a, or those and the plan
+  header = static_cast<const Header*>(map);
+  size_t n_points = 1;
+  uint32_t n_values = header->n_values;
+  bool valid = memcmp(header->magic, magic, sizeof(magic)) == 0 &&
+               header->n_axes == n_axes &&
+               (n_values == 2 || n_values == 2 + 2 * header->problem.N);
+  for (int d = 0; valid && d < n_axes; d++) {
+    valid = header->grid.points[d] >= 2 &&
+            header->grid.upper[d] > header->grid.lower[d];
+    n_points *= header->grid.points[d];
+    valid = valid && n_points <= map_size;
+  }
+  if (!valid || map_size != sizeof(Header) +
+                                n_points * header->n_values * sizeof(float)) {
+    Close();
+    return false;
+  }
+  values = reinterpret_cast<const float*>(
+      static_cast<const char*>(map) + sizeof(Header));
+  return true;
+}
+
+bool MPC_table::Solves(const MPC_config& config, double latency) const {
+  if (!header || !config.steps.empty() || !config.integrator.Euler() ||
+      !config.blocks.empty()) {
+    return false;
+  }
+  Problem problem = ProblemOf(config, latency);
+  const Problem& table = header->problem;
+  bool same = table.N == problem.N && table.dt == problem.dt &&
+              table.ref_v == problem.ref_v &&
+              table.latency == problem.latency &&
+              table.delta_max == problem.delta_max &&
+              table.a_max == problem.a_max && table.Lf == problem.Lf;
+  for (int i = 0; i < 7; i++) {
+    same = same && table.weights[i] == problem.weights[i];
+  }
+  return same;
+}
+
+bool MPC_table::Lookup(const double* key, MPC_result& result) const {
+  if (!header) {
+    return false;
+  }
+  const Grid& grid = header->grid;
+
+  // cell of the key and the position inside it
+  size_t cell[n_axes];
+  double fraction[n_axes];
+  for (int d = 0; d < n_axes; d++) {
+    double pos = (key[d] - grid.lower[d]) / (grid.upper[d] - grid.lower[d]) *
+                 (grid.points[d] - 1);
+    if (!(pos >= 0 && pos <= grid.points[d] - 1)) {
+      return false;
+    }
+    cell[d] = min((size_t)pos, (size_t)grid.points[d] - 2);
+    fraction[d] = pos - cell[d];
+  }
+
+  // corners of the cell and their weights
+  const uint32_t n_values = header->n_values;
+  const float* points[1 << n_axes];
+  double weights[1 << n_axes];
+  double delta_lo = 1e19, delta_hi = -1e19;
+  double a_lo = 1e19, a_hi = -1e19;
+  for (int corner = 0; corner < 1 << n_axes; corner++) {
+    size_t index = 0;
+    double weight = 1.0;
+    for (int d = 0; d < n_axes; d++) {
+      int upper = (corner >> d) & 1;
+      index = index * grid.points[d] + cell[d] + upper;
+      weight *= upper ? fraction[d] : 1.0 - fraction[d];
+    }
+    const float* point = values + index * n_values;
+    if (isnan(point[0])) {
+      return false;
+    }
+    delta_lo = min(delta_lo, (double)point[0]);
+    delta_hi = max(delta_hi, (double)point[0]);
+    a_lo = min(a_lo, (double)point[1]);
+    a_hi = max(a_hi, (double)point[1]);
+    points[corner] = point;
+    weights[corner] = weight;
+  }
+  if (delta_hi - delta_lo > max_spread_delta || a_hi - a_lo > max_spread_a) {
+    return false;
+  }
+
+  // weighted sum over the corners
+  size_t stages = (n_values - 2) / 2;
+  result.status = MPC_result::CONVERGED;
+  result.iterations = 0;
+  result.solve_ms = 0.0;
+  result.delta = 0.0;
+  result.a = 0.0;
+  result.x.assign(stages, 0.0);
+  result.y.assign(stages, 0.0);
+  for (int corner = 0; corner < 1 << n_axes; corner++) {
+    const float* point = points[corner];
+    double weight = weights[corner];
+    result.delta += weight * point[0];
+    result.a += weight * point[1];
+    for (size_t t = 0; t < stages; t++) {
+      result.x[t] += weight * point[2 + 2 * t];
+      result.y[t] += weight * point[3 + 2 * t];
+    }
+  }
+  return true;
+}
+
+void MPC_table::Key(double v, double delta, double a,
+                    const Eigen::VectorXd& coeffs, double latency,
+                    double* key) {
+  key[0] = v + a * latency;
+  key[1] = delta;
+  key[2] = coeffs[0];
+  key[3] = -atan(coeffs[1]);
+  key[4] = coeffs[2];
+  key[5] = coeffs[3];
+}
+
+// The speed during the latency is taken as the one after it, the
+// difference is the throttle times the squared latency.
+void MPC_table::Input(const double* key, double latency,
+                      Eigen::VectorXd& state, Eigen::VectorXd& coeffs) {
+  double v = key[0];
+  double delta = key[1];
+  double cte = key[2];
+  double epsi = key[3];
+  coeffs.resize(4);
+  coeffs << cte, -tan(epsi), key[4], key[5];
+  double psi = v / Lf * (-delta) * latency;
+  state.resize(6);
+  state << v * latency, 0.0, psi, v, cte + v * sin(epsi) * latency,
+      epsi + psi;
+}
+
+bool MPC_table::Write(const string& path, const Grid& grid,
+                      const Problem& problem, uint32_t n_values,
+                      const vector<float>& values) {
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, magic, sizeof(magic));
+  header.n_axes = n_axes;
+  header.n_values = n_values;
+  header.grid = grid;
+  header.problem = problem;
+
+  ofstream out(path.c_str(), ios::binary);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(&values[0]),
+            values.size() * sizeof(float));
+  return out.good();
+}
@@ -0,0 +1,103 @@
+#ifndef MPC_TABLE_H
+#define MPC_TABLE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Controller.h"
+#include "MPC.h"
+
+// Explicit MPC: the first actuations (optionally the whole plan) solved
+// offline by mpc_table on a grid, answered online by multilinear
+// interpolation from a memory-mapped file.
+//
+// The key of the table is what main.cpp knows before the latency
+// projection: the speed after the latency, the applied steering angle, the
+// cte and epsi of the vehicle, and the path coefficients k2 and k3 (k0 and
+// k1 follow from cte and epsi).
+class MPC_table {
+ public:
+  static const int n_axes = 6;
+
+  struct Grid {
+    uint32_t points[n_axes];
+    double lower[n_axes];
+    double upper[n_axes];
+  };
+
+  // What the table was solved for: the horizon, the reference speed and
+  // the latency of the key, and the weights and bounds of MPC_model.h it
+  // was built with.
+  struct Problem {
+    uint32_t N;
+    double dt;
+    double ref_v;
+    double latency;
+    double weights[7];
+    double delta_max;
+    double a_max;
+    double Lf;
+  };
+
+  MPC_table();
+  virtual ~MPC_table();
+
+  // Problem of `config` with the parameters of MPC_model.h.
+  static Problem ProblemOf(const MPC_config& config, double latency);
+
+  // Map the table written by Write, false when it cannot be read or is
+  // malformed.
+  bool Open(const std::string& path);
+
+  // Whether the open table was solved for the problem of `config` and
+  // `latency`, with uniform steps, the Euler model and no move blocks.
+  bool Solves(const MPC_config& config, double latency) const;
+
+  // Interpolate the result of a solve for `key`, the trajectory only when
+  // the table has the plans. False outside the grid, next to a point whose
+  // solve failed, or when the first actuations at the corners of the cell
+  // spread more than max_spread_delta and max_spread_a, e.g. across a
+  // change of the active bounds; `result` is left as it was then. The
+  // trajectory reuses the storage of `result`.
+  bool Lookup(const double* key, MPC_result& result) const;
+
+  double max_spread_delta;
+  double max_spread_a;
+
+  // Key of the telemetry: speed `v`, the applied actuations `delta` and `a`
+  // and the fitted path.
+  static void Key(double v, double delta, double a,
+                  const Eigen::VectorXd& coeffs, double latency, double* key);
+
+  // State and coefficients handed to MPC::Solve for `key`, projected over
+  // the latency like main.cpp does it.
+  static void Input(const double* key, double latency, Eigen::VectorXd& state,
+                    Eigen::VectorXd& coeffs);
+
+  // Write `values`, n_values floats for each grid point with the first axis
+  // varying slowest, NaN for a failed solve: delta and a, followed by the x
+  // and y of every stage for the plans.
+  // The problem of the solves goes into the header.
+  static bool Write(const std::string& path, const Grid& grid,
+                    const Problem& problem, uint32_t n_values,
+                    const std::vector<float>& values);
+
+ private:
+  struct Header {
+    char magic[8];
+    uint32_t n_axes;
+    uint32_t n_values;
+    Grid grid;
+    Problem problem;
+  };
+
+  void Close();
+
+  void* map;
+  size_t map_size;
+  const Header* header;
+  const float* values;
+};
+
+#endif /* MPC_TABLE_H */
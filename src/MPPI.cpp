@@ -0,0 +1,181 @@
+#include "MPPI.h"
+#include <math.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include "MPC_model.h"
+
+using namespace std;
+
+MPPI::MPPI(size_t N, const vector<double>& dt, int samples, int threads)
+    : u(N - 1, 2), x(N, 6), dt(dt), chunks(threads) {
+  this->N = N;
+  u.setZero();
+  x.setZero();
+  for (int i = 0; i < 4; i++) {
+    coeffs[i] = 0.0f;
+  }
+  ref_v = 0.0f;
+  sigma_delta = 0.05;
+  sigma_a = 0.3;
+  temperature = 0.1;
+  iterations = 1;
+
+  // samples are split evenly, the first chunks take the remainder
+  for (int i = 0; i < threads; i++) {
+    int n = samples / threads + (i < samples % threads ? 1 : 0);
+    chunks[i].gen.seed(1 + i);
+    chunks[i].delta.resize(n, N - 1);
+    chunks[i].a.resize(n, N - 1);
+    chunks[i].cost.resize(n);
+  }
+  if (threads > 1) {
+    pool.reset(new Eigen::NonBlockingThreadPool(threads));
+  }
+}
+
+void MPPI::SetParameters(const double* params) {
+  for (int i = 0; i < 4; i++) {
+    coeffs[i] = params[i];
+  }
+  ref_v = params[4];
+}
+
+void MPPI::Rollout(Chunk& chunk) {
+  const int n = chunk.cost.size();
+  const size_t M = N - 1;
+  const float half_pi = M_PI / 2;
+
+  // Perturbed actuations, clamped to the bounds. The first sample of the
+  // first chunk is the unperturbed sequence.
+  normal_distribution<float> normal(0.0f, 1.0f);
+  for (size_t t = 0; t < M; t++) {
+    for (int k = 0; k < n; k++) {
+      float delta = u(t, 0) + sigma_delta * normal(chunk.gen);
+      float a = u(t, 1) + sigma_a * normal(chunk.gen);
+      chunk.delta(k, t) = max(-(float)delta_max, min((float)delta_max, delta));
+      chunk.a(k, t) = max(-(float)a_max, min((float)a_max, a));
+    }
+  }
+  if (&chunk == &chunks[0] && n > 0) {
+    for (size_t t = 0; t < M; t++) {
+      chunk.delta(0, t) = u(t, 0);
+      chunk.a(0, t) = u(t, 1);
+    }
+  }
+
+  Eigen::ArrayXf px = Eigen::ArrayXf::Constant(n, x0[0]);
+  Eigen::ArrayXf py = Eigen::ArrayXf::Constant(n, x0[1]);
+  Eigen::ArrayXf psi = Eigen::ArrayXf::Constant(n, x0[2]);
+  Eigen::ArrayXf v = Eigen::ArrayXf::Constant(n, x0[3]);
+  Eigen::ArrayXf cte = Eigen::ArrayXf::Constant(n, x0[4]);
+  Eigen::ArrayXf epsi = Eigen::ArrayXf::Constant(n, x0[5]);
+  Eigen::ArrayXf& cost = chunk.cost;
+  cost.setZero();
+  for (size_t t = 0; t < N; t++) {
+    // the terms of FG_eval
+    cost += weight_cte * cte.square() + weight_epsi * epsi.square() +
+            weight_v * (v - ref_v).square();
+    if (t == M) {
+      break;
+    }
+    auto delta = chunk.delta.col(t);
+    auto a = chunk.a.col(t);
+    cost += weight_delta * delta.square() + weight_a * a.square();
+    if (t > 0) {
+      float rate = RateFactor(dt, t - 1);
+      cost += weight_delta_diff * rate *
+                  (delta - chunk.delta.col(t - 1)).square() +
+              weight_a_diff * rate * (a - chunk.a.col(t - 1)).square();
+    }
+
+    // The model, delta is negated for the simulator. The cosine is a
+    // shifted sine, which is vectorized on every target.
+    const float h = dt[t];
+    Eigen::ArrayXf f =
+        coeffs[0] + px * (coeffs[1] + px * (coeffs[2] + px * coeffs[3]));
+    Eigen::ArrayXf psides =
+        (coeffs[1] + px * (2 * coeffs[2] + 3 * coeffs[3] * px)).atan();
+    Eigen::ArrayXf step = v * h;
+    Eigen::ArrayXf turn = step * (-delta) / Lf;
+    px += step * (psi + half_pi).sin();
+    cte = (f - py) + step * epsi.sin();
+    py += step * psi.sin();
+    epsi = (psi - psides) + turn;
+    psi += turn;
+    v += a * h;
+  }
+}
+
+int MPPI::Solve(const Eigen::VectorXd& x0,
+                chrono::steady_clock::time_point deadline) {
+  this->x0 = x0;
+  int updates = 0;
+  while (updates < iterations) {
+    if (pool) {
+      // roll out the chunks on the pool and wait for all of them
+      mutex m;
+      condition_variable done;
+      size_t pending = chunks.size();
+      for (size_t i = 0; i < chunks.size(); i++) {
+        pool->Schedule([this, i, &m, &done, &pending]() {
+          Rollout(chunks[i]);
+          lock_guard<mutex> lock(m);
+          if (--pending == 0) {
+            done.notify_one();
+          }
+        });
+      }
+      unique_lock<mutex> lock(m);
+      done.wait(lock, [&pending]() { return pending == 0; });
+    } else {
+      Rollout(chunks[0]);
+    }
+
+    // weights relative to the best sample
+    float best = chunks[0].cost.minCoeff();
+    double mean = 0.0;
+    size_t samples = 0;
+    for (const Chunk& chunk : chunks) {
+      best = min(best, chunk.cost.minCoeff());
+    }
+    for (const Chunk& chunk : chunks) {
+      mean += (chunk.cost - best).cast<double>().sum();
+      samples += chunk.cost.size();
+    }
+    double lambda = max(temperature * mean / samples, 1e-6);
+
+    Eigen::MatrixXd sum = Eigen::MatrixXd::Zero(N - 1, 2);
+    double total = 0.0;
+    for (const Chunk& chunk : chunks) {
+      Eigen::VectorXd w =
+          (-(chunk.cost - best).cast<double>() / lambda).exp().matrix();
+      sum.col(0) += chunk.delta.cast<double>().matrix().transpose() * w;
+      sum.col(1) += chunk.a.cast<double>().matrix().transpose() * w;
+      total += w.sum();
+    }
+    u = sum / total;
+    updates++;
+    if (chrono::steady_clock::now() >= deadline) {
+      break;
+    }
+  }
+
+  // the plan, in double precision
+  x.row(0) = x0.head(6).transpose();
+  for (size_t t = 0; t + 1 < N; t++) {
+    double px = x(t, 0), py = x(t, 1), psi = x(t, 2);
+    double v = x(t, 3), epsi = x(t, 5);
+    double delta = u(t, 0), a = u(t, 1);
+    double dt = this->dt[t];
+    double f = coeffs[0] + px * (coeffs[1] + px * (coeffs[2] + px * coeffs[3]));
+    double psides = atan(coeffs[1] + px * (2 * coeffs[2] + 3 * coeffs[3] * px));
+    x(t + 1, 0) = px + v * cos(psi) * dt;
+    x(t + 1, 1) = py + v * sin(psi) * dt;
+    x(t + 1, 2) = psi + v * (-delta) / Lf * dt;
+    x(t + 1, 3) = v + a * dt;
+    x(t + 1, 4) = (f - py) + v * sin(epsi) * dt;
+    x(t + 1, 5) = (psi - psides) + v * (-delta) / Lf * dt;
+  }
+  return updates;
+}
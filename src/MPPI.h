@@ -0,0 +1,73 @@
+#ifndef MPPI_H
+#define MPPI_H
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+
+// Model predictive path integral control on the cost and the kinematic
+// model of FG_eval.
+//
+// Every update rolls out `samples` perturbed copies of the actuation
+// sequence through the model and replaces the sequence by the average of
+// the samples, weighted by exp(-cost / lambda). No derivatives are needed.
+//
+// The rollouts are in single precision and structure-of-arrays: each state
+// is an array over the samples of a chunk, so the model, including sin and
+// the cubic path, is evaluated with the packet math of Eigen (SSE, AVX or
+// AVX-512, whatever the build targets). The chunks are spread over a thread
+// pool.
+class MPPI {
+ public:
+  // `threads` is the number of chunks rolled out in parallel, step t takes
+  // dt[t].
+  MPPI(size_t N, const std::vector<double>& dt, int samples, int threads);
+
+  // Polynomial coefficients of the path and reference velocity.
+  void SetParameters(const double* params);
+
+  // Update the actuations `u` (the starting guess) from the initial state
+  // `x0` (x, y, psi, v, cte, epsi) `iterations` times, or until the
+  // wall-clock `deadline` passes, and roll the result out into `x`. Returns
+  // the number of updates.
+  int Solve(const Eigen::VectorXd& x0,
+            std::chrono::steady_clock::time_point deadline);
+
+  // N - 1 actuations (delta, a) and the N states of their rollout
+  Eigen::MatrixXd u;
+  Eigen::MatrixXd x;
+
+  // standard deviation of the perturbations
+  double sigma_delta;
+  double sigma_a;
+  // lambda relative to the mean cost above the best sample
+  double temperature;
+  int iterations;
+
+ private:
+  // Samples of one thread, column t holds stage t of all of them.
+  struct Chunk {
+    std::mt19937 gen;
+    Eigen::ArrayXXf delta;
+    Eigen::ArrayXXf a;
+    Eigen::ArrayXf cost;
+  };
+
+  // Perturb the actuations of a chunk and accumulate the cost of its
+  // rollouts.
+  void Rollout(Chunk& chunk);
+
+  size_t N;
+  std::vector<double> dt;
+  float coeffs[4];
+  float ref_v;
+  Eigen::VectorXd x0;
+
+  std::vector<Chunk> chunks;
+  std::unique_ptr<Eigen::NonBlockingThreadPool> pool;
+};
+
+#endif /* MPPI_H */
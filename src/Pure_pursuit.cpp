@@ -0,0 +1,86 @@
+#include "Pure_pursuit.h"
+#include <math.h>
+#include <algorithm>
+#include "MPC_integrator.h"
+#include "MPC_model.h"
+
+using namespace std;
+
+// Step lengths of the horizon of `config`.
+static vector<double> Steps(const MPC_config& config) {
+  if (!config.steps.empty()) {
+    return config.steps;
+  }
+  return vector<double>(config.N - 1, config.dt);
+}
+
+Pure_pursuit::Pure_pursuit(const MPC_config& config) : dt(Steps(config)) {
+  ref_v = config.ref_v;
+  lookahead_time = 0.5;
+  min_lookahead = 8.0;
+  max_lateral = 60.0;
+  speed_gain = 0.2;
+}
+
+void Pure_pursuit::Actuation(const Eigen::VectorXd& state,
+                             const Eigen::VectorXd& coeffs, double& delta,
+                             double& a) const {
+  double px = state[0];
+  double py = state[1];
+  double psi = state[2];
+  double v = state[3];
+  double lookahead = max(min_lookahead, lookahead_time * v);
+
+  // walk the path ahead to the point at the lookahead distance, with the
+  // largest curvature on the way
+  const double dx = 0.5;
+  double tx = px;
+  double ty = py;
+  double curvature = 0.0;
+  for (double x = px; x < px + 4 * lookahead; x += dx) {
+    double f = coeffs[0] + x * (coeffs[1] + x * (coeffs[2] + x * coeffs[3]));
+    double d1 = coeffs[1] + x * (2 * coeffs[2] + 3 * coeffs[3] * x);
+    double d2 = 2 * coeffs[2] + 6 * coeffs[3] * x;
+    curvature = max(curvature, fabs(d2) / pow(1 + d1 * d1, 1.5));
+    tx = x;
+    ty = f;
+    if ((tx - px) * (tx - px) + (ty - py) * (ty - py) >=
+        lookahead * lookahead) {
+      break;
+    }
+  }
+  double distance = max(sqrt((tx - px) * (tx - px) + (ty - py) * (ty - py)),
+                        dx);
+  double alpha = atan2(ty - py, tx - px) - psi;
+
+  // delta is negated for the simulator, see MPC_integrator::Rate
+  delta = -Lf * 2 * sin(alpha) / distance;
+  delta = max(-delta_max, min(delta_max, delta));
+  double target_v = ref_v;
+  if (curvature > 0.0) {
+    target_v = min(target_v, sqrt(max_lateral / curvature));
+  }
+  a = max(-a_max, min(a_max, speed_gain * (target_v - v)));
+}
+
+MPC_result Pure_pursuit::Plan(const Eigen::VectorXd& state,
+                              const Eigen::VectorXd& coeffs,
+                              chrono::steady_clock::time_point deadline) {
+  MPC_result result;
+  result.status = MPC_result::CONVERGED;
+  Actuation(state, coeffs, result.delta, result.a);
+
+  double z[6];
+  for (int i = 0; i < 6; i++) {
+    z[i] = state[i];
+  }
+  MPC_integrator euler;
+  for (size_t t = 0; t <= dt.size(); t++) {
+    result.x.push_back(z[0]);
+    result.y.push_back(z[1]);
+    if (t < dt.size()) {
+      euler.Step(z, result.delta, result.a, dt[t]);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,50 @@
+#ifndef PURE_PURSUIT_H
+#define PURE_PURSUIT_H
+
+#include <chrono>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+// Geometric path tracking on the fitted coefficients, without a horizon to
+// optimize: it answers in microseconds, e.g. as the fallback of MPC_race.
+//
+// The steering follows the arc through the point of the path a lookahead
+// distance ahead (pure pursuit): at the angle alpha between the heading
+// and that point, the arc has the curvature 2 sin(alpha) / lookahead and
+// the kinematic model of FG_eval drives it at delta = Lf times that. The
+// speed is held at the reference speed, or lower where the path curves
+// over the lookahead so that v^2 k stays within `max_lateral`.
+//
+// The trajectory of the result is the model rolled out over the horizon
+// of the config with the actuation held.
+class Pure_pursuit : public Controller {
+ public:
+  // The horizon, steps and reference speed of `config` are used.
+  explicit Pure_pursuit(const MPC_config& config = MPC_config());
+
+  // lookahead distance, lookahead_time * v but at least min_lookahead
+  double lookahead_time;
+  double min_lookahead;
+  // largest v^2 k of the speed target
+  double max_lateral;
+  // acceleration per unit of speed error
+  double speed_gain;
+
+  // Steering angle and acceleration at the state (x, y, psi, v, ...) for
+  // the path `coeffs`.
+  void Actuation(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                 double& delta, double& a) const;
+
+ protected:
+  // Actuation for an initial state (x, y, psi, v, cte, epsi) in the vehicle
+  // frame and the polynomial coefficients; it never fails nor waits.
+  MPC_result Plan(const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  std::chrono::steady_clock::time_point deadline);
+
+ private:
+  std::vector<double> dt;
+  double ref_v;
+};
+
+#endif /* PURE_PURSUIT_H */
@@ -0,0 +1,143 @@
+#include "QP_admm.h"
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+QP_admm::QP_admm() {
+  rho = 0.1;
+  sigma = 1e-6;
+  alpha = 1.6;
+  eps_abs = 1e-4;
+  eps_rel = 1e-4;
+  max_iterations = 4000;
+  check_interval = 10;
+  factorizations = 0;
+  factored = false;
+}
+
+void QP_admm::SetMatrices(const SparseMatrix& P, const SparseMatrix& A) {
+  this->P = P;
+  this->A = A;
+  At = A.transpose();
+  factored = false;
+}
+
+bool QP_admm::Factor(const Eigen::VectorXd& l, const Eigen::VectorXd& u) {
+  const int n = P.rows();
+  const int m = A.rows();
+  // equality rows get a larger step, like in OSQP
+  rho_vec.resize(m);
+  for (int i = 0; i < m; i++) {
+    rho_vec[i] = l[i] == u[i] ? 1e3 * rho : rho;
+  }
+
+  // lower triangle of the KKT matrix
+  vector<Eigen::Triplet<double> > triplets;
+  triplets.reserve(P.nonZeros() + A.nonZeros() + n + m);
+  for (int j = 0; j < n; j++) {
+    triplets.push_back(Eigen::Triplet<double>(j, j, sigma));
+    for (SparseMatrix::InnerIterator it(P, j); it; ++it) {
+      if (it.row() >= j) {
+        triplets.push_back(Eigen::Triplet<double>(it.row(), j, it.value()));
+      }
+    }
+    for (SparseMatrix::InnerIterator it(A, j); it; ++it) {
+      triplets.push_back(
+          Eigen::Triplet<double>(n + it.row(), j, it.value()));
+    }
+  }
+  for (int i = 0; i < m; i++) {
+    triplets.push_back(Eigen::Triplet<double>(n + i, n + i, -1.0 / rho_vec[i]));
+  }
+  SparseMatrix kkt(n + m, n + m);
+  kkt.setFromTriplets(triplets.begin(), triplets.end());
+
+  // the ordering and the elimination tree only depend on the pattern
+  bool same = outer.size() == (size_t)kkt.outerSize() + 1 &&
+              inner.size() == (size_t)kkt.nonZeros() &&
+              equal(outer.begin(), outer.end(), kkt.outerIndexPtr()) &&
+              equal(inner.begin(), inner.end(), kkt.innerIndexPtr());
+  if (!same) {
+    outer.assign(kkt.outerIndexPtr(),
+                 kkt.outerIndexPtr() + kkt.outerSize() + 1);
+    inner.assign(kkt.innerIndexPtr(), kkt.innerIndexPtr() + kkt.nonZeros());
+    ldlt.analyzePattern(kkt);
+  }
+  ldlt.factorize(kkt);
+  factorizations++;
+  factored = ldlt.info() == Eigen::Success;
+  return factored;
+}
+
+int QP_admm::Solve(const Eigen::VectorXd& q, const Eigen::VectorXd& l,
+                   const Eigen::VectorXd& u,
+                   chrono::steady_clock::time_point deadline) {
+  const int n = P.rows();
+  const int m = A.rows();
+  if (x.size() != n) {
+    x = Eigen::VectorXd::Zero(n);
+  }
+  if (y.size() != m) {
+    y = Eigen::VectorXd::Zero(m);
+  }
+  // a change of the equality rows needs another rho per row
+  bool refactor = !factored;
+  for (int i = 0; i < m && !refactor; i++) {
+    refactor = (l[i] == u[i]) != (rho_vec[i] != rho);
+  }
+  if (refactor && !Factor(l, u)) {
+    return -1;
+  }
+
+  z = (A * x).cwiseMax(l).cwiseMin(u);
+  Eigen::VectorXd rhs(n + m);
+  for (int iteration = 1; iteration <= max_iterations; iteration++) {
+    rhs.head(n) = sigma * x - q;
+    rhs.tail(m) = z - y.cwiseQuotient(rho_vec);
+    Eigen::VectorXd solution = ldlt.solve(rhs);
+    Eigen::VectorXd z_tilde =
+        z + (solution.tail(m) - y).cwiseQuotient(rho_vec);
+
+    // relaxed updates, z is projected onto the bounds
+    x = alpha * solution.head(n) + (1.0 - alpha) * x;
+    Eigen::VectorXd z_relaxed = alpha * z_tilde + (1.0 - alpha) * z;
+    Eigen::VectorXd z_next =
+        (z_relaxed + y.cwiseQuotient(rho_vec)).cwiseMax(l).cwiseMin(u);
+    y += rho_vec.cwiseProduct(z_relaxed - z_next);
+    z = z_next;
+
+    if (iteration % check_interval != 0) {
+      continue;
+    }
+    Eigen::VectorXd Ax = A * x;
+    Eigen::VectorXd Px = P * x;
+    Eigen::VectorXd Aty = At * y;
+    double primal = (Ax - z).cwiseAbs().maxCoeff();
+    double dual = (Px + q + Aty).cwiseAbs().maxCoeff();
+    double primal_scale = max(Ax.cwiseAbs().maxCoeff(),
+                              z.cwiseAbs().maxCoeff());
+    double dual_scale = max(max(Px.cwiseAbs().maxCoeff(),
+                                Aty.cwiseAbs().maxCoeff()),
+                            q.cwiseAbs().maxCoeff());
+    if (primal <= eps_abs + eps_rel * primal_scale &&
+        dual <= eps_abs + eps_rel * dual_scale) {
+      return iteration;
+    }
+    if (chrono::steady_clock::now() >= deadline) {
+      return -1;
+    }
+
+    // Balance the residuals. A new rho needs a new factorization, so it is
+    // only changed when it is off by a large factor.
+    double ratio = sqrt((primal / max(primal_scale, 1e-10)) /
+                        (dual / max(dual_scale, 1e-10) + 1e-10));
+    if (ratio > 5.0 || ratio < 0.2) {
+      rho = min(max(rho * ratio, 1e-6), 1e6);
+      if (!Factor(l, u)) {
+        return -1;
+      }
+    }
+  }
+  return -1;
+}
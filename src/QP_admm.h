@@ -0,0 +1,76 @@
+#ifndef QP_ADMM_H
+#define QP_ADMM_H
+
+#include <chrono>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/SparseCholesky"
+#include "Eigen-3.3/Eigen/SparseCore"
+
+// Sparse convex QP
+//   min 0.5 x' P x + q' x  s.t.  l <= A x <= u
+// solved with the operator splitting of OSQP (ADMM). Every iteration solves
+// the quasi-definite KKT system
+//   [P + sigma I   A'         ] [x]
+//   [A             -diag(1/rho)] [v]
+// whose LDLT factorization only changes with the matrices and rho, so it is
+// reused by all the iterations in between.
+//
+// The iterates x and y stay in the object and are the warm start of the next
+// call of Solve.
+class QP_admm {
+ public:
+  typedef Eigen::SparseMatrix<double> SparseMatrix;
+
+  QP_admm();
+
+  // Set P (symmetric, both triangles) and A. The symbolic analysis of the
+  // KKT matrix is kept as long as the sparsity pattern does not change.
+  void SetMatrices(const SparseMatrix& P, const SparseMatrix& A);
+
+  // Run ADMM from the current x and y until the residuals meet the
+  // tolerances or the wall-clock `deadline` passes. Returns the number of
+  // iterations, or -1 without convergence; x and y are then the last
+  // iterates.
+  int Solve(const Eigen::VectorXd& q, const Eigen::VectorXd& l,
+            const Eigen::VectorXd& u,
+            std::chrono::steady_clock::time_point deadline);
+
+  // primal solution and multipliers of the rows of A
+  Eigen::VectorXd x;
+  Eigen::VectorXd y;
+
+  // step size of the rows with l < u, equality rows use a multiple of it;
+  // adapted during Solve and kept for the next call
+  double rho;
+  double sigma;
+  // relaxation
+  double alpha;
+  double eps_abs;
+  double eps_rel;
+  int max_iterations;
+  // iterations between the residual checks
+  int check_interval;
+
+  // number of numeric factorizations, for benchmarking
+  int factorizations;
+
+ private:
+  // Numeric factorization of the KKT matrix for the current rho.
+  bool Factor(const Eigen::VectorXd& l, const Eigen::VectorXd& u);
+
+  SparseMatrix P;
+  SparseMatrix A;
+  SparseMatrix At;
+  Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower> ldlt;
+  // pattern of the analyzed KKT matrix
+  std::vector<int> outer;
+  std::vector<int> inner;
+  // rho of the current factorization, per row of A
+  Eigen::VectorXd rho_vec;
+  bool factored;
+  // auxiliary variable z = A x at the solution
+  Eigen::VectorXd z;
+};
+
+#endif /* QP_ADMM_H */
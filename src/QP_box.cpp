@@ -0,0 +1,94 @@
+#include "QP_box.h"
+#include <vector>
+#include "Eigen-3.3/Eigen/Cholesky"
+
+int SolveBoxQP(const Eigen::MatrixXd& H, const Eigen::VectorXd& g,
+               const Eigen::VectorXd& lb, const Eigen::VectorXd& ub,
+               Eigen::VectorXd& x, int max_iterations) {
+  const int n = g.size();
+  // working set: 0 free, -1 fixed at the lower bound, 1 at the upper bound
+  std::vector<int> fixed(n, 0);
+  for (int i = 0; i < n; i++) {
+    if (x[i] <= lb[i]) {
+      x[i] = lb[i];
+      fixed[i] = -1;
+    } else if (x[i] >= ub[i]) {
+      x[i] = ub[i];
+      fixed[i] = 1;
+    }
+  }
+
+  std::vector<int> free;
+  for (int iteration = 1; iteration <= max_iterations; iteration++) {
+    Eigen::VectorXd gradient = H * x + g;
+
+    // Newton step on the free variables, the fixed ones stay at their bound
+    free.clear();
+    for (int i = 0; i < n; i++) {
+      if (fixed[i] == 0) {
+        free.push_back(i);
+      }
+    }
+    const int m = free.size();
+    Eigen::VectorXd step = Eigen::VectorXd::Zero(n);
+    if (m > 0) {
+      Eigen::MatrixXd H_free(m, m);
+      Eigen::VectorXd g_free(m);
+      for (int i = 0; i < m; i++) {
+        for (int j = 0; j < m; j++) {
+          H_free(i, j) = H(free[i], free[j]);
+        }
+        g_free[i] = -gradient[free[i]];
+      }
+      Eigen::VectorXd p = H_free.llt().solve(g_free);
+      for (int i = 0; i < m; i++) {
+        step[free[i]] = p[i];
+      }
+    }
+
+    // longest step up to 1 that stays within the bounds
+    double alpha = 1.0;
+    int blocking = -1;
+    for (int i : free) {
+      if (step[i] < 0 && x[i] + step[i] < lb[i]) {
+        double limit = (lb[i] - x[i]) / step[i];
+        if (limit < alpha) {
+          alpha = limit;
+          blocking = i;
+        }
+      } else if (step[i] > 0 && x[i] + step[i] > ub[i]) {
+        double limit = (ub[i] - x[i]) / step[i];
+        if (limit < alpha) {
+          alpha = limit;
+          blocking = i;
+        }
+      }
+    }
+    x += alpha * step;
+    if (blocking >= 0) {
+      fixed[blocking] = step[blocking] < 0 ? -1 : 1;
+      x[blocking] = fixed[blocking] < 0 ? lb[blocking] : ub[blocking];
+      continue;
+    }
+
+    // The free variables are optimal. A fixed variable whose multiplier has
+    // the wrong sign would decrease the cost by leaving its bound, the one
+    // with the largest violation is released.
+    gradient = H * x + g;
+    int release = -1;
+    double worst = 1e-9;
+    for (int i = 0; i < n; i++) {
+      double violation = fixed[i] < 0 ? -gradient[i]
+                         : fixed[i] > 0 ? gradient[i] : 0.0;
+      if (violation > worst) {
+        worst = violation;
+        release = i;
+      }
+    }
+    if (release < 0) {
+      return iteration;
+    }
+    fixed[release] = 0;
+  }
+  return -1;
+}
@@ -0,0 +1,17 @@
+#ifndef QP_BOX_H
+#define QP_BOX_H
+
+#include "Eigen-3.3/Eigen/Core"
+
+// Dense convex QP with simple bounds
+//   min 0.5 * x' H x + g' x  s.t.  lb <= x <= ub,
+// solved with a primal active-set method. H must be positive definite.
+//
+// `x` is the starting point, it is clamped into the bounds. Returns the
+// number of iterations, or -1 when the method did not terminate within
+// `max_iterations`.
+int SolveBoxQP(const Eigen::MatrixXd& H, const Eigen::VectorXd& g,
+               const Eigen::VectorXd& lb, const Eigen::VectorXd& ub,
+               Eigen::VectorXd& x, int max_iterations = 100);
+
+#endif /* QP_BOX_H */
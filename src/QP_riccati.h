@@ -0,0 +1,276 @@
+#ifndef QP_RICCATI_H
+#define QP_RICCATI_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "Eigen-3.3/Eigen/Cholesky"
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/StdVector"
+
+// Linear-quadratic optimal control problem over the stages k = 0 .. N - 1
+//   min  sum_k 0.5 z_k' Q_k z_k + q_k' z_k
+//          + sum_{k < N - 1} u_k' S_k z_k + 0.5 u_k' R_k u_k + r_k' u_k
+//   s.t. z_{k + 1} = A_k z_k + B_k u_k + d_k,  z_0 given,
+//        lb_k <= u_k <= ub_k,
+// solved with a primal-dual interior-point method (Mehrotra predictor-
+// corrector). The Newton system of every iteration is solved with a Riccati
+// recursion over the stages, so an iteration costs O(N) fixed-size NX x NX
+// and NX x NU kernels instead of a general sparse factorization.
+template <int NX, int NU>
+class QP_riccati {
+ public:
+  typedef Eigen::Matrix<double, NX, NX> MatrixXX;
+  typedef Eigen::Matrix<double, NX, NU> MatrixXU;
+  typedef Eigen::Matrix<double, NU, NX> MatrixUX;
+  typedef Eigen::Matrix<double, NU, NU> MatrixUU;
+  typedef Eigen::Matrix<double, NX, 1> VectorX;
+  typedef Eigen::Matrix<double, NU, 1> VectorU;
+
+  // Data of one stage. The last stage only uses Q and q.
+  struct Stage {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    MatrixXX A;
+    MatrixXU B;
+    VectorX d;
+    MatrixXX Q;
+    VectorX q;
+    MatrixUX S;
+    MatrixUU R;
+    VectorU r;
+    VectorU lb;
+    VectorU ub;
+  };
+
+  explicit QP_riccati(size_t N)
+      : stages(N), z(N), u(N - 1), s_l(N - 1), s_u(N - 1), m_l(N - 1),
+        m_u(N - 1), K(N - 1), k(N - 1), Se(N - 1), Re(N - 1), dz(N),
+        du(N - 1), ds_l(N - 1), ds_u(N - 1), dm_l(N - 1), dm_u(N - 1),
+        gz(N), gu(N - 1), r_l(N - 1), r_u(N - 1), c_l(N - 1), c_u(N - 1) {
+    tolerance = 1e-8;
+    max_iterations = 50;
+  }
+
+  std::vector<Stage, Eigen::aligned_allocator<Stage> > stages;
+  VectorX z0;
+  double tolerance;
+  int max_iterations;
+
+  // Solution of the last call of Solve.
+  std::vector<VectorX, Eigen::aligned_allocator<VectorX> > z;
+  std::vector<VectorU, Eigen::aligned_allocator<VectorU> > u;
+
+  // Returns the number of iterations, or -1 without convergence. The
+  // stationarity is measured relative to the largest linear term, the
+  // other conditions are absolute.
+  int Solve() {
+    const size_t N = stages.size();
+    const size_t M = N - 1;
+    const double n_bounds = 2.0 * NU * M;
+    double scale = 1.0 + stages[M].q.cwiseAbs().maxCoeff();
+    for (size_t i = 0; i < M; i++) {
+      scale = std::max(scale, 1.0 + stages[i].q.cwiseAbs().maxCoeff());
+      scale = std::max(scale, 1.0 + stages[i].r.cwiseAbs().maxCoeff());
+    }
+
+    // The start satisfies the dynamics, the bounds are reached through the
+    // slacks.
+    z[0] = z0;
+    for (size_t i = 0; i < M; i++) {
+      const Stage& stage = stages[i];
+      u[i].setZero();
+      z[i + 1] = stage.A * z[i] + stage.B * u[i] + stage.d;
+      for (int j = 0; j < NU; j++) {
+        s_l[i][j] = std::max(u[i][j] - stage.lb[j], 1.0);
+        s_u[i][j] = std::max(stage.ub[j] - u[i][j], 1.0);
+      }
+      m_l[i].setOnes();
+      m_u[i].setOnes();
+    }
+
+    for (int iteration = 1; iteration <= max_iterations; iteration++) {
+      // residuals of the optimality conditions
+      double gap = 0.0;
+      double primal = 0.0;
+      for (size_t i = 0; i < M; i++) {
+        gap += s_l[i].dot(m_l[i]) + s_u[i].dot(m_u[i]);
+        r_l[i] = u[i] - stages[i].lb - s_l[i];
+        r_u[i] = stages[i].ub - u[i] - s_u[i];
+        primal = std::max(primal, r_l[i].cwiseAbs().maxCoeff());
+        primal = std::max(primal, r_u[i].cwiseAbs().maxCoeff());
+      }
+      double mu = gap / n_bounds;
+      Gradient();
+      if (mu < tolerance && primal < tolerance &&
+          Dual() < tolerance * scale) {
+        return iteration - 1;
+      }
+
+      if (!Factor()) {
+        return -1;
+      }
+
+      // predictor, the affine scaling direction
+      for (size_t i = 0; i < M; i++) {
+        c_l[i] = s_l[i].cwiseProduct(m_l[i]);
+        c_u[i] = s_u[i].cwiseProduct(m_u[i]);
+      }
+      Direction();
+      double alpha = StepLength(1.0);
+      double gap_affine = 0.0;
+      for (size_t i = 0; i < M; i++) {
+        gap_affine +=
+            (s_l[i] + alpha * ds_l[i]).dot(m_l[i] + alpha * dm_l[i]) +
+            (s_u[i] + alpha * ds_u[i]).dot(m_u[i] + alpha * dm_u[i]);
+      }
+      double sigma = pow(gap_affine / gap, 3);
+
+      // corrector, centered and with the second order term of the predictor
+      for (size_t i = 0; i < M; i++) {
+        c_l[i] = s_l[i].cwiseProduct(m_l[i]) +
+                 ds_l[i].cwiseProduct(dm_l[i]) -
+                 VectorU::Constant(sigma * mu);
+        c_u[i] = s_u[i].cwiseProduct(m_u[i]) +
+                 ds_u[i].cwiseProduct(dm_u[i]) -
+                 VectorU::Constant(sigma * mu);
+      }
+      Direction();
+      alpha = StepLength(0.995);
+
+      for (size_t i = 0; i < N; i++) {
+        z[i] += alpha * dz[i];
+      }
+      for (size_t i = 0; i < M; i++) {
+        u[i] += alpha * du[i];
+        s_l[i] += alpha * ds_l[i];
+        s_u[i] += alpha * ds_u[i];
+        m_l[i] += alpha * dm_l[i];
+        m_u[i] += alpha * dm_u[i];
+      }
+    }
+    return -1;
+  }
+
+ private:
+  // Gradient of the cost at the current point.
+  void Gradient() {
+    const size_t M = stages.size() - 1;
+    for (size_t i = 0; i <= M; i++) {
+      const Stage& stage = stages[i];
+      gz[i] = stage.Q * z[i] + stage.q;
+      if (i < M) {
+        gz[i] += stage.S.transpose() * u[i];
+        gu[i] = stage.R * u[i] + stage.S * z[i] + stage.r - m_l[i] + m_u[i];
+      }
+    }
+  }
+
+  // Largest residual of the stationarity of the controls. The multipliers
+  // of the dynamics come from the stationarity of the states, backwards.
+  double Dual() {
+    const size_t M = stages.size() - 1;
+    VectorX nu = gz[M];
+    double dual = 0.0;
+    for (size_t i = M; i-- > 0;) {
+      VectorU residual = gu[i] + stages[i].B.transpose() * nu;
+      dual = std::max(dual, residual.cwiseAbs().maxCoeff());
+      nu = gz[i] + stages[i].A.transpose() * nu;
+    }
+    return dual;
+  }
+
+  // Riccati recursion of the Newton system. The bounds enter the control
+  // Hessian through the diagonal of the barrier. False when a reduced
+  // control Hessian is not positive definite, e.g. for a nonconvex stage.
+  bool Factor() {
+    const size_t M = stages.size() - 1;
+    MatrixXX P = stages[M].Q;
+    for (size_t i = M; i-- > 0;) {
+      const Stage& stage = stages[i];
+      VectorU sigma = m_l[i].cwiseQuotient(s_l[i]) +
+                      m_u[i].cwiseQuotient(s_u[i]);
+      MatrixXU PB = P * stage.B;
+      MatrixUU R = stage.R + stage.B.transpose() * PB;
+      R.diagonal() += sigma;
+      Se[i] = stage.S + PB.transpose() * stage.A;
+      Re[i].compute(R);
+      if (Re[i].info() != Eigen::Success) {
+        return false;
+      }
+      K[i] = -Re[i].solve(Se[i]);
+      P = stage.Q + stage.A.transpose() * P * stage.A +
+          Se[i].transpose() * K[i];
+      P = 0.5 * (P + P.transpose()).eval();
+    }
+    return true;
+  }
+
+  // Newton direction for the complementarity targets c_l and c_u.
+  void Direction() {
+    const size_t M = stages.size() - 1;
+
+    // the bounds condensed into the gradient of the controls
+    VectorX p = gz[M];
+    for (size_t i = M; i-- > 0;) {
+      const Stage& stage = stages[i];
+      VectorU r = gu[i] +
+                  (c_l[i] + m_l[i].cwiseProduct(r_l[i])).cwiseQuotient(s_l[i]) -
+                  (c_u[i] + m_u[i].cwiseProduct(r_u[i])).cwiseQuotient(s_u[i]);
+      k[i] = -Re[i].solve(r + stage.B.transpose() * p);
+      p = gz[i] + stage.A.transpose() * p + Se[i].transpose() * k[i];
+    }
+
+    // the start satisfies the dynamics, so the direction keeps them
+    dz[0].setZero();
+    for (size_t i = 0; i < M; i++) {
+      const Stage& stage = stages[i];
+      du[i] = K[i] * dz[i] + k[i];
+      dz[i + 1] = stage.A * dz[i] + stage.B * du[i];
+      ds_l[i] = du[i] + r_l[i];
+      ds_u[i] = r_u[i] - du[i];
+      dm_l[i] = -(c_l[i] + m_l[i].cwiseProduct(ds_l[i])).cwiseQuotient(s_l[i]);
+      dm_u[i] = -(c_u[i] + m_u[i].cwiseProduct(ds_u[i])).cwiseQuotient(s_u[i]);
+    }
+  }
+
+  static double Limit(double value, double step, double fraction) {
+    return step < 0 ? -fraction * value / step : 1.0;
+  }
+
+  // Largest step up to 1 that keeps `fraction` of the distance of the
+  // slacks and the multipliers to zero.
+  double StepLength(double fraction) {
+    double alpha = 1.0;
+    for (size_t i = 0; i < du.size(); i++) {
+      for (int j = 0; j < NU; j++) {
+        alpha = std::min(alpha, Limit(s_l[i][j], ds_l[i][j], fraction));
+        alpha = std::min(alpha, Limit(s_u[i][j], ds_u[i][j], fraction));
+        alpha = std::min(alpha, Limit(m_l[i][j], dm_l[i][j], fraction));
+        alpha = std::min(alpha, Limit(m_u[i][j], dm_u[i][j], fraction));
+      }
+    }
+    return alpha;
+  }
+
+  typedef std::vector<VectorX, Eigen::aligned_allocator<VectorX> > VectorsX;
+  typedef std::vector<VectorU, Eigen::aligned_allocator<VectorU> > VectorsU;
+
+  // slacks and multipliers of the lower and upper bounds
+  VectorsU s_l, s_u, m_l, m_u;
+  // Riccati factorization: feedback gains, feedforward terms, and the
+  // factored control Hessians
+  std::vector<MatrixUX, Eigen::aligned_allocator<MatrixUX> > K;
+  VectorsU k;
+  std::vector<MatrixUX, Eigen::aligned_allocator<MatrixUX> > Se;
+  typedef Eigen::LLT<MatrixUU> Cholesky;
+  std::vector<Cholesky, Eigen::aligned_allocator<Cholesky> > Re;
+  // Newton direction
+  VectorsX dz;
+  VectorsU du, ds_l, ds_u, dm_l, dm_u;
+  // gradient of the Lagrangian, primal residuals of the bounds and
+  // complementarity targets
+  VectorsX gz;
+  VectorsU gu, r_l, r_u, c_l, c_u;
+};
+
+#endif /* QP_RICCATI_H */
@@ -0,0 +1,1045 @@
+// Closed-loop benchmark of the MPC on the lake track.
+//
+// The vehicle is driven around lake_track_waypoints.csv with the kinematic
+// model of the controller. Every control period the telemetry is prepared
+// the same way main.cpp does it (vehicle frame, cubic fit, latency
+// projection) and handed to the solver, whose wall time is recorded
+// together with the distance of the vehicle to the track.
+//
+// Usage: mpc_bench [waypoints.csv] [ticks]
+//
+// Every solve gets the control period as its deadline.
+//
+// The derivatives of the analytic and the generated backends are also
+// compared to the CppAD ones at random points before the closed-loop runs.
+// Then many controllers drive concurrently on a thread pool, every backend
+// of MPC_registry solves on the telemetry of Ipopt, and the last runs
+// sweep the horizon N with Ipopt and the other optimizers. For each
+// horizon the KKT matrix of both variable layouts is factorized as well.
+// Then move blocking patterns are compared at the default and twice the
+// default horizon, uniform steps against non-uniform ones, and last the
+// horizon chosen per tick against the default one, also with a time budget
+// as short as on a loaded machine.
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "Eigen-3.3/Eigen/OrderingMethods"
+#include "Eigen-3.3/Eigen/SparseCholesky"
+#include "Eigen-3.3/unsupported/Eigen/CXX11/ThreadPool"
+#include "FG_analytic.h"
+#include "MPC.h"
+#include "MPC_adaptive.h"
+#include "MPC_fixed.h"
+#include "MPC_frenet.h"
+#include "MPC_multistart.h"
+#include "MPC_race.h"
+#include "MPC_registry.h"
+#include "Pure_pursuit.h"
+#include "helpers.h"
+
+using namespace std;
+
+// control period and actuation latency of the simulator, 100 ms
+const double period = 0.1;
+// the simulator sends 6 waypoints around the vehicle
+const int n_waypoints = 6;
+
+// Deadline of a solve started now.
+chrono::steady_clock::time_point Deadline() {
+  return chrono::steady_clock::now() + chrono::milliseconds(100);
+}
+
+struct Track {
+  vector<double> x;
+  vector<double> y;
+};
+
+struct Vehicle {
+  double x;
+  double y;
+  double psi;
+  double v;
+};
+
+struct Stats {
+  vector<double> solve_ms;
+  // preparation phase of the real-time iteration, not part of solve_ms
+  vector<double> prepare_ms;
+  vector<int> iterations;
+  int truncated;
+  int failed;
+  double cte_sum;
+  double cte_max;
+};
+
+// Solver under test: state and coefficients in the vehicle frame, and the
+// global pose of that frame.
+typedef function<MPC_result(const Eigen::VectorXd&, const Eigen::VectorXd&,
+                            const Vehicle&)> Solver;
+
+// Work done after the actuation is applied, before the next telemetry,
+// given the coefficients of the tick.
+typedef function<void(const Eigen::VectorXd&)> Preparation;
+
+bool LoadTrack(const string& path, Track& track) {
+  ifstream in(path.c_str());
+  if (!in) {
+    return false;
+  }
+  string line;
+  // skip the "x,y" header
+  getline(in, line);
+  while (getline(in, line)) {
+    stringstream ss(line);
+    string x, y;
+    if (getline(ss, x, ',') && getline(ss, y)) {
+      track.x.push_back(atof(x.c_str()));
+      track.y.push_back(atof(y.c_str()));
+    }
+  }
+  return track.x.size() > n_waypoints;
+}
+
+// Distance from a point to the closed polyline of the track.
+double TrackDistance(const Track& track, double px, double py) {
+  double best = 1.0e19;
+  size_t n = track.x.size();
+  for (size_t i = 0; i < n; i++) {
+    double ax = track.x[i], ay = track.y[i];
+    double bx = track.x[(i + 1) % n], by = track.y[(i + 1) % n];
+    double dx = bx - ax, dy = by - ay;
+    double t = ((px - ax) * dx + (py - ay) * dy) / (dx * dx + dy * dy);
+    t = max(0.0, min(1.0, t));
+    best = min(best, hypot(ax + t * dx - px, ay + t * dy - py));
+  }
+  return best;
+}
+
+Stats RunClosedLoop(const Track& track, int ticks, Solver solve,
+                    Preparation prepare = Preparation()) {
+  Stats stats;
+  stats.truncated = 0;
+  stats.failed = 0;
+  stats.cte_sum = 0.0;
+  stats.cte_max = 0.0;
+
+  size_t n = track.x.size();
+  Vehicle car;
+  car.x = track.x[0];
+  car.y = track.y[0];
+  car.psi = atan2(track.y[1] - track.y[0], track.x[1] - track.x[0]);
+  car.v = 10.0;
+  // actuation currently applied to the vehicle
+  double delta = 0.0;
+  double a = 0.0;
+
+  for (int tick = 0; tick < ticks; tick++) {
+    // waypoints around the closest one, like the simulator sends them
+    size_t closest = 0;
+    for (size_t i = 1; i < n; i++) {
+      if (hypot(track.x[i] - car.x, track.y[i] - car.y) <
+          hypot(track.x[closest] - car.x, track.y[closest] - car.y)) {
+        closest = i;
+      }
+    }
+    Eigen::VectorXd ptsx_car(n_waypoints);
+    Eigen::VectorXd ptsy_car(n_waypoints);
+    for (int i = 0; i < n_waypoints; i++) {
+      size_t k = (closest + n - 1 + i) % n;
+      double x = track.x[k] - car.x;
+      double y = track.y[k] - car.y;
+      ptsx_car[i] = x * cos(car.psi) + y * sin(car.psi);
+      ptsy_car[i] = -x * sin(car.psi) + y * cos(car.psi);
+    }
+    Eigen::VectorXd coeffs = polyfit(ptsx_car, ptsy_car, 3);
+
+    // vehicle frame state projected over the latency, as in main.cpp
+    double cte = polyeval(coeffs, 0.0);
+    double epsi = -atan(coeffs[1]);
+    Eigen::VectorXd state(6);
+    state << car.v * period, 0.0, car.v / Lf * (-delta) * period,
+        car.v + a * period, cte + car.v * sin(epsi) * period,
+        epsi + car.v / Lf * (-delta) * period;
+
+    auto t0 = chrono::steady_clock::now();
+    MPC_result result = solve(state, coeffs, car);
+    auto t1 = chrono::steady_clock::now();
+    stats.solve_ms.push_back(
+        chrono::duration<double, milli>(t1 - t0).count());
+    stats.iterations.push_back(result.iterations);
+    if (result.status == MPC_result::TRUNCATED) {
+      stats.truncated++;
+    } else if (result.status == MPC_result::FAILED) {
+      stats.failed++;
+    }
+
+    // the previous actuation is still applied during the latency, the new
+    // one takes over for the next period
+    const int substeps = 10;
+    double h = period / substeps;
+    for (int i = 0; i < substeps; i++) {
+      car.x += car.v * cos(car.psi) * h;
+      car.y += car.v * sin(car.psi) * h;
+      car.psi += car.v / Lf * (-delta) * h;
+      car.v += a * h;
+    }
+    if (result.status != MPC_result::FAILED) {
+      delta = result.delta;
+      a = result.a;
+    } else {
+      a = 0.0;
+    }
+
+    if (prepare) {
+      auto t2 = chrono::steady_clock::now();
+      prepare(coeffs);
+      auto t3 = chrono::steady_clock::now();
+      stats.prepare_ms.push_back(
+          chrono::duration<double, milli>(t3 - t2).count());
+    }
+
+    double d = TrackDistance(track, car.x, car.y);
+    stats.cte_sum += d;
+    stats.cte_max = max(stats.cte_max, d);
+  }
+  return stats;
+}
+
+void Report(const string& label, const Stats& stats) {
+  vector<double> ms = stats.solve_ms;
+  sort(ms.begin(), ms.end());
+  double sum = 0.0;
+  for (double t : ms) {
+    sum += t;
+  }
+  double iterations = 0.0;
+  for (int i : stats.iterations) {
+    iterations += i;
+  }
+  cout << label << ": " << ms.size() << " solves"
+       << ", mean " << sum / ms.size() << " ms"
+       << ", median " << ms[ms.size() / 2] << " ms"
+       << ", max " << ms.back() << " ms"
+       << ", mean iterations " << iterations / ms.size()
+       << ", truncated " << stats.truncated << ", failed " << stats.failed
+       << ", mean |cte| " << stats.cte_sum / ms.size()
+       << ", max |cte| " << stats.cte_max << endl;
+  if (!stats.prepare_ms.empty()) {
+    double prepare = 0.0;
+    for (double t : stats.prepare_ms) {
+      prepare += t;
+    }
+    cout << "  preparation: mean " << prepare / stats.prepare_ms.size()
+         << " ms, max "
+         << *max_element(stats.prepare_ms.begin(), stats.prepare_ms.end())
+         << " ms" << endl;
+  }
+}
+
+// Stress test of concurrent controllers: `instances` MPC objects, each with
+// its own reference velocity, tape and vehicle, drive on a pool of
+// `threads` threads at once, alternating between Ipopt and the Riccati
+// SQP. Every closed loop has to match the same controller run alone. The
+// deadline is far off, so waiting for the other threads cannot truncate a
+// solve.
+void CheckConcurrency(const Track& track, int ticks, int instances,
+                      int threads) {
+  auto drive = [&track, ticks](int i) {
+    MPC_config config;
+    config.ref_v = 40.0 + 5.0 * (i % 7);
+    MPC mpc(config, MPC::CPPAD);
+    mpc.optimizer = i % 2 ? MPC::RICCATI : MPC::IPOPT;
+    return RunClosedLoop(track, ticks,
+        [&mpc](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+               const Vehicle& car) {
+          mpc.SetFrame(car.x, car.y, car.psi);
+          return mpc.Solve(state, coeffs,
+                           chrono::steady_clock::now() + chrono::seconds(10));
+        });
+  };
+
+  auto t0 = chrono::steady_clock::now();
+  vector<Stats> alone;
+  for (int i = 0; i < instances; i++) {
+    alone.push_back(drive(i));
+  }
+  auto t1 = chrono::steady_clock::now();
+  vector<Stats> together(instances);
+  {
+    Eigen::NonBlockingThreadPool pool(threads);
+    mutex m;
+    condition_variable done;
+    int pending = instances;
+    for (int i = 0; i < instances; i++) {
+      pool.Schedule([&, i]() {
+        together[i] = drive(i);
+        lock_guard<mutex> lock(m);
+        if (--pending == 0) {
+          done.notify_one();
+        }
+      });
+    }
+    unique_lock<mutex> lock(m);
+    done.wait(lock, [&pending]() { return pending == 0; });
+  }
+  auto t2 = chrono::steady_clock::now();
+
+  int mismatches = 0;
+  for (int i = 0; i < instances; i++) {
+    if (alone[i].cte_sum != together[i].cte_sum ||
+        alone[i].iterations != together[i].iterations) {
+      mismatches++;
+    }
+  }
+  cout << "concurrency: " << instances << " controllers, one after another "
+       << chrono::duration<double>(t1 - t0).count() << " s, on " << threads
+       << " threads " << chrono::duration<double>(t2 - t1).count() << " s, "
+       << mismatches << " mismatches" << endl;
+}
+
+// The controller with the compile-time horizon H, its result copied into an
+// MPC_result after the solve.
+template <size_t H>
+void ReportFixed(const Track& track, int ticks) {
+  MPC_fixed<H> fixed;
+  Report("N = " + to_string(H) + ", fixed", RunClosedLoop(track, ticks,
+      [&fixed](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+               const Vehicle& car) {
+        typename MPC_fixed<H>::Result solution =
+            fixed.Solve(state, coeffs, Deadline());
+        MPC_result result;
+        result.status = solution.status;
+        result.iterations = solution.iterations;
+        result.delta = solution.vars[0];
+        result.a = solution.vars[1];
+        return result;
+      }));
+}
+
+// Accuracy of the prediction of `integrator` in steps of h over about 1.5 s
+// of a turn while accelerating, against the same integrated in fine steps.
+void ReportPrediction(const string& label, const MPC_integrator& integrator,
+                      double h) {
+  const double delta = -0.2;
+  const double a = 1.0;
+  int steps = (int)round(1.5 / h);
+  double exact[6] = {0.0, 0.0, 0.0, 20.0, 0.0, 0.0};
+  MPC_integrator(MPC_integrator::RK4, 1000).Step(exact, delta, a, steps * h);
+  double z[6] = {0.0, 0.0, 0.0, 20.0, 0.0, 0.0};
+  for (int i = 0; i < steps; i++) {
+    integrator.Step(z, delta, a, h);
+  }
+  cout << "prediction " << label << ": " << steps << " steps, position error "
+       << hypot(z[0] - exact[0], z[1] - exact[1]) << " m, heading error "
+       << fabs(z[2] - exact[2]) << " rad" << endl;
+}
+
+// A/B test of the backends of MPC_registry on the same telemetry: `driver`
+// drives, and every tick the others solve the same state and path without
+// acting on it. Their actuations are compared to the applied ones.
+void CompareBackends(const Track& track, int ticks, const string& driver) {
+  struct Shadow {
+    string name;
+    unique_ptr<Controller> controller;
+    vector<double> solve_ms;
+    int failed;
+    int compared;
+    double delta_sum;
+    double a_sum;
+  };
+  // the options of main.cpp without flags, which every backend solves
+  MPC_options options;
+  vector<Shadow> shadows;
+  Controller* driving = nullptr;
+  for (const auto& backend : MPC_registry::Backends()) {
+    string error;
+    unique_ptr<Controller> controller =
+        MPC_registry::Make(backend.first, options, error);
+    if (!controller) {
+      cout << "backend " << backend.first << ": " << error << endl;
+      continue;
+    }
+    if (backend.first == driver) {
+      driving = controller.get();
+    }
+    shadows.push_back({backend.first, move(controller), {}, 0, 0, 0.0, 0.0});
+  }
+  if (!driving) {
+    cout << "backend " << driver << " is not registered" << endl;
+    return;
+  }
+
+  RunClosedLoop(track, ticks,
+      [&shadows, driving](const Eigen::VectorXd& state,
+                          const Eigen::VectorXd& coeffs, const Vehicle& car) {
+        driving->SetFrame(car.x, car.y, car.psi);
+        MPC_result applied = driving->Solve(state, coeffs, Deadline());
+        for (Shadow& shadow : shadows) {
+          MPC_result result = applied;
+          if (shadow.controller.get() != driving) {
+            shadow.controller->SetFrame(car.x, car.y, car.psi);
+            result = shadow.controller->Solve(state, coeffs, Deadline());
+          }
+          shadow.solve_ms.push_back(result.solve_ms);
+          if (result.status == MPC_result::FAILED) {
+            shadow.failed++;
+          } else if (applied.status != MPC_result::FAILED) {
+            shadow.compared++;
+            shadow.delta_sum += fabs(result.delta - applied.delta);
+            shadow.a_sum += fabs(result.a - applied.a);
+          }
+        }
+        return applied;
+      });
+
+  for (const Shadow& shadow : shadows) {
+    double sum = 0.0;
+    for (double t : shadow.solve_ms) {
+      sum += t;
+    }
+    size_t n = shadow.solve_ms.size();
+    cout << "backend " << shadow.name << " on the telemetry of " << driver
+         << ": mean " << sum / n << " ms, max "
+         << *max_element(shadow.solve_ms.begin(), shadow.solve_ms.end())
+         << " ms, failed " << shadow.failed << ", mean |delta - applied| "
+         << shadow.delta_sum / max(shadow.compared, 1)
+         << ", mean |a - applied| " << shadow.a_sum / max(shadow.compared, 1)
+         << endl;
+  }
+}
+
+// Sparse matrix in triplet form keyed by (row, column), so backends with a
+// different order of the nonzeros can be compared.
+typedef map<pair<int, int>, double> Triplets;
+
+Triplets JacTriplets(FG_backend& backend, const vector<double>& x) {
+  size_t nnz = backend.JacNonzeros();
+  vector<int> rows(nnz), cols(nnz);
+  vector<double> values(nnz);
+  backend.JacStructure(&rows[0], &cols[0]);
+  backend.EvalJacG(&x[0], true, &values[0]);
+  Triplets triplets;
+  for (size_t k = 0; k < nnz; k++) {
+    triplets[make_pair(rows[k], cols[k])] += values[k];
+  }
+  return triplets;
+}
+
+Triplets HesTriplets(FG_backend& backend, const vector<double>& x,
+                     double obj_factor, const vector<double>& lambda) {
+  size_t nnz = backend.HesNonzeros();
+  vector<int> rows(nnz), cols(nnz);
+  vector<double> values(nnz);
+  backend.HesStructure(&rows[0], &cols[0]);
+  backend.EvalH(&x[0], true, obj_factor, &lambda[0], &values[0]);
+  Triplets triplets;
+  for (size_t k = 0; k < nnz; k++) {
+    triplets[make_pair(rows[k], cols[k])] += values[k];
+  }
+  return triplets;
+}
+
+// Largest difference of two sparse matrices, a missing entry counts as 0.
+double MaxDifference(const Triplets& a, const Triplets& b) {
+  double diff = 0.0;
+  for (auto& entry : a) {
+    auto other = b.find(entry.first);
+    double value = other == b.end() ? 0.0 : other->second;
+    diff = max(diff, fabs(entry.second - value));
+  }
+  for (auto& entry : b) {
+    if (a.find(entry.first) == a.end()) {
+      diff = max(diff, fabs(entry.second));
+    }
+  }
+  return diff;
+}
+
+// Compare the cost, constraints and derivatives of two backends at random
+// points, parameters and multipliers.
+void CheckDerivatives(FG_backend& expected, FG_backend& actual, int points) {
+  mt19937 gen(1);
+  uniform_real_distribution<double> uniform(-1.0, 1.0);
+  size_t n = expected.NumVars();
+  size_t m = expected.NumConstraints();
+
+  double f_diff = 0.0, grad_diff = 0.0, g_diff = 0.0;
+  double jac_diff = 0.0, hes_diff = 0.0;
+  for (int p = 0; p < points; p++) {
+    double params[5];
+    for (int i = 0; i < 4; i++) {
+      params[i] = uniform(gen) / (1 + i * i);
+    }
+    params[4] = 70.0;
+    expected.SetParameters(params);
+    actual.SetParameters(params);
+
+    vector<double> x(n), lambda(m);
+    for (size_t i = 0; i < n; i++) {
+      x[i] = uniform(gen);
+    }
+    for (size_t i = 0; i < m; i++) {
+      lambda[i] = uniform(gen);
+    }
+    double obj_factor = uniform(gen);
+
+    f_diff = max(f_diff, fabs(expected.EvalF(&x[0], true) -
+                              actual.EvalF(&x[0], true)));
+
+    vector<double> a(n), b(n);
+    expected.EvalGradF(&x[0], true, &a[0]);
+    actual.EvalGradF(&x[0], true, &b[0]);
+    for (size_t i = 0; i < n; i++) {
+      grad_diff = max(grad_diff, fabs(a[i] - b[i]));
+    }
+
+    a.resize(m);
+    b.resize(m);
+    expected.EvalG(&x[0], true, &a[0]);
+    actual.EvalG(&x[0], true, &b[0]);
+    for (size_t i = 0; i < m; i++) {
+      g_diff = max(g_diff, fabs(a[i] - b[i]));
+    }
+
+    jac_diff = max(jac_diff, MaxDifference(JacTriplets(expected, x),
+                                           JacTriplets(actual, x)));
+    hes_diff = max(hes_diff,
+                   MaxDifference(HesTriplets(expected, x, obj_factor, lambda),
+                                 HesTriplets(actual, x, obj_factor, lambda)));
+  }
+  cout << "derivatives at " << points << " points, max difference"
+       << ": f " << f_diff << ", grad f " << grad_diff << ", g " << g_diff
+       << ", jacobian " << jac_diff << " (" << expected.JacNonzeros() << "/"
+       << actual.JacNonzeros() << " nonzeros)"
+       << ", hessian " << hes_diff << " (" << expected.HesNonzeros() << "/"
+       << actual.HesNonzeros() << " nonzeros)" << endl;
+}
+
+// Fill-in and time of the LDL' factorization of the regularized KKT matrix
+// [H + d I, J'; J, -d I] of the problem in `layout`, the matrix of a Newton
+// step of Ipopt. It is a proxy: Eigen's SimplicialLDLT factorizes the matrix
+// built here, not MUMPS inside Ipopt. In the stage-major layout the
+// multipliers of the constraint rows of a stage are also placed next to its
+// variables, so the matrix is banded. The natural ordering factorizes the
+// matrix as it is, AMD reorders it first like MUMPS does.
+template <typename Ordering>
+void ReportFactorization(const string& label, const MPC_layout& layout) {
+  typedef Eigen::SparseMatrix<double> SparseMatrix;
+  FG_analytic backend(layout, vector<double>(layout.N - 1, dt));
+  size_t n = backend.NumVars();
+  size_t m = backend.NumConstraints();
+  mt19937 gen(1);
+  uniform_real_distribution<double> uniform(-1.0, 1.0);
+  double params[5] = {0.5, -0.1, 0.01, -0.001, 70.0};
+  backend.SetParameters(params);
+  vector<double> x(n), lambda(m);
+  for (size_t i = 0; i < n; i++) {
+    x[i] = uniform(gen);
+  }
+  for (size_t i = 0; i < m; i++) {
+    lambda[i] = uniform(gen);
+  }
+
+  // position of the variables, then of the multipliers, in the matrix:
+  // stage t is [rows of t, states of t, actuators of t] in stage-major
+  vector<size_t> position(n + m);
+  for (size_t i = 0; i < n + m; i++) {
+    position[i] = i;
+  }
+  if (layout.order == MPC_layout::STAGE_MAJOR) {
+    const size_t block = MPC_layout::n_state + MPC_layout::n_stage;
+    for (size_t i = 0; i < n; i++) {
+      position[i] = i / MPC_layout::n_stage * block + MPC_layout::n_state +
+                    i % MPC_layout::n_stage;
+    }
+    for (size_t i = 0; i < m; i++) {
+      position[n + i] =
+          i / MPC_layout::n_state * block + i % MPC_layout::n_state;
+    }
+  }
+
+  // lower triangle of the KKT matrix
+  const double regularization = 1e-8;
+  vector<Eigen::Triplet<double> > triplets;
+  auto entry = [&](size_t row, size_t col, double value) {
+    row = position[row];
+    col = position[col];
+    triplets.push_back(
+        Eigen::Triplet<double>(max(row, col), min(row, col), value));
+  };
+  for (const auto& h : HesTriplets(backend, x, 1.0, lambda)) {
+    entry(h.first.first, h.first.second, h.second);
+  }
+  for (const auto& j : JacTriplets(backend, x)) {
+    entry(n + j.first.first, j.first.second, j.second);
+  }
+  for (size_t i = 0; i < n + m; i++) {
+    entry(i, i, i < n ? regularization : -regularization);
+  }
+  SparseMatrix kkt(n + m, n + m);
+  kkt.setFromTriplets(triplets.begin(), triplets.end());
+
+  const int repeats = 200;
+  Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, Ordering> ldlt;
+  ldlt.analyzePattern(kkt);
+  auto t0 = chrono::steady_clock::now();
+  for (int r = 0; r < repeats; r++) {
+    ldlt.factorize(kkt);
+  }
+  auto t1 = chrono::steady_clock::now();
+  cout << label << ", eigen ldlt proxy: kkt " << n + m << " rows, "
+       << kkt.nonZeros()
+       << " nonzeros, factor " << ldlt.matrixL().nestedExpression().nonZeros()
+       << " nonzeros, factorization "
+       << chrono::duration<double, micro>(t1 - t0).count() / repeats
+       << " us" << (ldlt.info() == Eigen::Success ? "" : ", failed") << endl;
+}
+
+int main(int argc, char* argv[]) {
+  string path = argc > 1 ? argv[1] : "../lake_track_waypoints.csv";
+  int ticks = argc > 2 ? atoi(argv[2]) : 300;
+
+  Track track;
+  if (!LoadTrack(path, track)) {
+    cerr << "Failed to read the waypoints from " << path << endl;
+    return -1;
+  }
+
+  MPC cppad(MPC::CPPAD);
+  MPC analytic(MPC::ANALYTIC);
+  MPC generated(MPC::GENERATED);
+  CheckDerivatives(cppad.Backend(), analytic.Backend(), 20);
+  CheckDerivatives(cppad.Backend(), generated.Backend(), 20);
+
+  // Per-solve setup overhead: a fresh MPC for every tick records the tape
+  // and builds the Ipopt application again, which is what every solve used
+  // to pay. The persistent MPC only pays it once.
+  Report("setup per solve", RunClosedLoop(track, ticks,
+      [](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+         const Vehicle& car) {
+        MPC mpc(MPC::CPPAD);
+        return mpc.Solve(state, coeffs, Deadline());
+      }));
+
+  MPC cold(MPC::CPPAD);
+  cold.warm_start = false;
+  Report("persistent, cold start", RunClosedLoop(track, ticks,
+      [&cold](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+              const Vehicle& car) {
+        return cold.Solve(state, coeffs, Deadline());
+      }));
+
+  Report("persistent, warm start", RunClosedLoop(track, ticks,
+      [&cppad](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+               const Vehicle& car) {
+        cppad.SetFrame(car.x, car.y, car.psi);
+        return cppad.Solve(state, coeffs, Deadline());
+      }));
+
+  Report("persistent, warm start, analytic", RunClosedLoop(track, ticks,
+      [&analytic](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  const Vehicle& car) {
+        analytic.SetFrame(car.x, car.y, car.psi);
+        return analytic.Solve(state, coeffs, Deadline());
+      }));
+
+  Report("persistent, warm start, generated", RunClosedLoop(track, ticks,
+      [&generated](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                   const Vehicle& car) {
+        generated.SetFrame(car.x, car.y, car.psi);
+        return generated.Solve(state, coeffs, Deadline());
+      }));
+
+  // Hessians of the Lagrangian: the exact one of the tape above against the
+  // Gauss-Newton matrix of the cost and L-BFGS
+  MPC_config gn_config;
+  gn_config.hessian = MPC_config::GAUSS_NEWTON;
+  MPC gauss_newton(gn_config, MPC::CPPAD);
+  Report("persistent, warm start, gauss-newton", RunClosedLoop(track, ticks,
+      [&gauss_newton](const Eigen::VectorXd& state,
+                      const Eigen::VectorXd& coeffs, const Vehicle& car) {
+        gauss_newton.SetFrame(car.x, car.y, car.psi);
+        return gauss_newton.Solve(state, coeffs, Deadline());
+      }));
+
+  MPC_config lbfgs_config;
+  lbfgs_config.hessian = MPC_config::LBFGS;
+  MPC lbfgs(lbfgs_config, MPC::CPPAD);
+  Report("persistent, warm start, l-bfgs", RunClosedLoop(track, ticks,
+      [&lbfgs](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+               const Vehicle& car) {
+        lbfgs.SetFrame(car.x, car.y, car.psi);
+        return lbfgs.Solve(state, coeffs, Deadline());
+      }));
+
+  MPC_config ldlt_config;
+  ldlt_config.linear_solver = MPC_config::EIGEN_LDLT;
+  MPC ldlt(ldlt_config);
+  Report("persistent, warm start, generated, eigen ldlt",
+         RunClosedLoop(track, ticks,
+      [&ldlt](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+              const Vehicle& car) {
+        ldlt.SetFrame(car.x, car.y, car.psi);
+        return ldlt.Solve(state, coeffs, Deadline());
+      }));
+
+  // Real-time iteration: solve times are the feedback phase only, the
+  // preparation runs between the ticks.
+  MPC rti;
+  rti.real_time_iteration = true;
+  Report("real-time iteration", RunClosedLoop(track, ticks,
+      [&rti](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+             const Vehicle& car) {
+        rti.SetFrame(car.x, car.y, car.psi);
+        return rti.Solve(state, coeffs, Deadline());
+      },
+      [&rti](const Eigen::VectorXd& coeffs) { rti.Prepare(coeffs); }));
+
+  CheckConcurrency(track, min(ticks, 100), 16,
+                   max(2u, thread::hardware_concurrency()));
+
+  // every registered backend on the telemetry of the default one
+  CompareBackends(track, ticks, "ipopt");
+
+  // Longer horizons, Ipopt on the sparse problem against the Riccati and
+  // the ADMM SQP, iLQR, MPPI, the fixed-horizon Riccati SQP and the Riccati
+  // SQP of the problem in path coordinates.
+  // Both use the analytic derivatives, the generated kernels only exist for
+  // the default N.
+  for (size_t horizon : {10, 20, 50, 100}) {
+    string n = "N = " + to_string(horizon);
+    MPC_layout variable_major(horizon, MPC_layout::VARIABLE_MAJOR);
+    MPC_layout stage_major(horizon, MPC_layout::STAGE_MAJOR);
+    ReportFactorization<Eigen::NaturalOrdering<int> >(
+        n + ", variable-major", variable_major);
+    ReportFactorization<Eigen::NaturalOrdering<int> >(
+        n + ", stage-major", stage_major);
+    ReportFactorization<Eigen::AMDOrdering<int> >(
+        n + ", variable-major, amd", variable_major);
+    ReportFactorization<Eigen::AMDOrdering<int> >(
+        n + ", stage-major, amd", stage_major);
+
+    MPC ipopt(MPC::ANALYTIC, horizon);
+    Report("N = " + to_string(horizon) + ", ipopt", RunClosedLoop(track, ticks,
+        [&ipopt](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                 const Vehicle& car) {
+          ipopt.SetFrame(car.x, car.y, car.psi);
+          return ipopt.Solve(state, coeffs, Deadline());
+        }));
+
+    MPC_config config;
+    config.N = horizon;
+    config.linear_solver = MPC_config::EIGEN_LDLT;
+    MPC eigen(config, MPC::ANALYTIC);
+    Report(n + ", ipopt, eigen ldlt", RunClosedLoop(track, ticks,
+        [&eigen](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                 const Vehicle& car) {
+          eigen.SetFrame(car.x, car.y, car.psi);
+          return eigen.Solve(state, coeffs, Deadline());
+        }));
+
+    config.linear_solver = MPC_config::MUMPS;
+    config.layout = MPC_layout::STAGE_MAJOR;
+    MPC staged(config, MPC::ANALYTIC);
+    Report(n + ", ipopt, stage-major", RunClosedLoop(track, ticks,
+        [&staged](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  const Vehicle& car) {
+          staged.SetFrame(car.x, car.y, car.psi);
+          return staged.Solve(state, coeffs, Deadline());
+        }));
+
+    MPC riccati(MPC::ANALYTIC, horizon);
+    riccati.optimizer = MPC::RICCATI;
+    Report("N = " + to_string(horizon) + ", riccati",
+           RunClosedLoop(track, ticks,
+        [&riccati](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                   const Vehicle& car) {
+          riccati.SetFrame(car.x, car.y, car.psi);
+          return riccati.Solve(state, coeffs, Deadline());
+        }));
+
+    MPC admm(MPC::ANALYTIC, horizon);
+    admm.optimizer = MPC::ADMM;
+    Report("N = " + to_string(horizon) + ", admm", RunClosedLoop(track, ticks,
+        [&admm](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                const Vehicle& car) {
+          admm.SetFrame(car.x, car.y, car.psi);
+          return admm.Solve(state, coeffs, Deadline());
+        }));
+
+    MPC ilqr(MPC::ANALYTIC, horizon);
+    ilqr.optimizer = MPC::ILQR;
+    Report("N = " + to_string(horizon) + ", ilqr", RunClosedLoop(track, ticks,
+        [&ilqr](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                const Vehicle& car) {
+          ilqr.SetFrame(car.x, car.y, car.psi);
+          return ilqr.Solve(state, coeffs, Deadline());
+        }));
+
+    MPC mppi(MPC::ANALYTIC, horizon);
+    mppi.optimizer = MPC::MPPI;
+    Report("N = " + to_string(horizon) + ", mppi", RunClosedLoop(track, ticks,
+        [&mppi](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                const Vehicle& car) {
+          mppi.SetFrame(car.x, car.y, car.psi);
+          return mppi.Solve(state, coeffs, Deadline());
+        }));
+
+    // the Riccati SQP again, with the horizon fixed at compile time
+    if (horizon == 10) {
+      ReportFixed<10>(track, ticks);
+    } else if (horizon == 20) {
+      ReportFixed<20>(track, ticks);
+    } else if (horizon == 50) {
+      ReportFixed<50>(track, ticks);
+    } else if (horizon == 100) {
+      ReportFixed<100>(track, ticks);
+    }
+
+    // four states instead of six, with its own weights of the offset and
+    // the steering rate
+    MPC_frenet frenet(config);
+    Report(n + ", frenet", RunClosedLoop(track, ticks,
+        [&frenet](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  const Vehicle& car) {
+          return frenet.Solve(state, coeffs, Deadline());
+        }));
+  }
+
+  // Move blocking: the actuation is held over blocks of steps, so a longer
+  // horizon needs fewer variables. Ipopt and the ADMM SQP, the solvers of
+  // blocked problems.
+  vector<vector<size_t> > patterns = {{}, {1, 1, 2, 2, 4}, {2}, {4}};
+  for (size_t horizon : {N, 2 * N}) {
+    for (const vector<size_t>& blocks : patterns) {
+      MPC_config config;
+      config.N = horizon;
+      config.blocks = blocks;
+      string label = "N = " + to_string(horizon) + ", blocks";
+      for (size_t length : blocks) {
+        label += " " + to_string(length);
+      }
+      if (blocks.empty()) {
+        label += " none";
+      }
+      MPC_layout layout(horizon, MPC_layout::VARIABLE_MAJOR, blocks);
+      label += " (" + to_string(layout.n_vars) + " variables)";
+
+      MPC ipopt(config, MPC::ANALYTIC);
+      Report(label + ", ipopt", RunClosedLoop(track, ticks,
+          [&ipopt](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                   const Vehicle& car) {
+            ipopt.SetFrame(car.x, car.y, car.psi);
+            return ipopt.Solve(state, coeffs, Deadline());
+          }));
+
+      MPC admm(config, MPC::ANALYTIC);
+      admm.optimizer = MPC::ADMM;
+      Report(label + ", admm", RunClosedLoop(track, ticks,
+          [&admm](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                  const Vehicle& car) {
+            admm.SetFrame(car.x, car.y, car.psi);
+            return admm.Solve(state, coeffs, Deadline());
+          }));
+    }
+  }
+
+  // Step lengths: a preview of 1.5 s in uniform steps of the latency
+  // against the same preview with the steps after the first 0.5 s doubled,
+  // and fine steps in the near term.
+  vector<pair<string, vector<double> > > horizons = {
+      {"15 x 0.1 s", vector<double>(15, 0.1)},
+      {"5 x 0.1 s + 5 x 0.2 s",
+       {0.1, 0.1, 0.1, 0.1, 0.1, 0.2, 0.2, 0.2, 0.2, 0.2}},
+      {"5 x 0.05 s + 5 x 0.2 s",
+       {0.05, 0.05, 0.05, 0.05, 0.05, 0.2, 0.2, 0.2, 0.2, 0.2}}};
+  vector<pair<string, MPC::Optimizer> > optimizers = {
+      {"ipopt", MPC::IPOPT},
+      {"riccati", MPC::RICCATI},
+      {"admm", MPC::ADMM},
+      {"ilqr", MPC::ILQR}};
+  for (const auto& horizon : horizons) {
+    MPC_config config;
+    config.steps = horizon.second;
+    for (const auto& optimizer : optimizers) {
+      MPC mpc(config, MPC::ANALYTIC);
+      mpc.optimizer = optimizer.second;
+      Report("steps " + horizon.first + ", " + optimizer.first,
+             RunClosedLoop(track, ticks,
+          [&mpc](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                 const Vehicle& car) {
+            mpc.SetFrame(car.x, car.y, car.psi);
+            return mpc.Solve(state, coeffs, Deadline());
+          }));
+    }
+  }
+
+  // Integrators: a preview of 1.5 s in steps of the latency against 1.6 s
+  // in steps twice as long, with Euler substeps or a higher order keeping
+  // the prediction accurate. All on the tape, the only backend of the other
+  // integrators.
+  vector<pair<string, MPC_integrator> > integrators = {
+      {"euler", MPC_integrator()},
+      {"euler x 2", MPC_integrator(MPC_integrator::EULER, 2)},
+      {"rk2", MPC_integrator(MPC_integrator::RK2)},
+      {"rk4", MPC_integrator(MPC_integrator::RK4)}};
+  for (double h : {0.1, 0.2}) {
+    for (const auto& integrator : integrators) {
+      ReportPrediction(to_string(h).substr(0, 3) + " s, " + integrator.first,
+                       integrator.second, h);
+    }
+  }
+  vector<pair<string, MPC_config> > shootings;
+  shootings.push_back(make_pair("15 x 0.1 s, euler", MPC_config()));
+  shootings.back().second.steps = vector<double>(15, 0.1);
+  for (const auto& integrator : integrators) {
+    shootings.push_back(make_pair("8 x 0.2 s, " + integrator.first,
+                                  MPC_config()));
+    shootings.back().second.steps = vector<double>(8, 0.2);
+    shootings.back().second.integrator = integrator.second;
+  }
+  for (const auto& shooting : shootings) {
+    for (const auto& optimizer : optimizers) {
+      if (optimizer.second == MPC::ILQR) {
+        continue;
+      }
+      MPC mpc(shooting.second, MPC::CPPAD);
+      mpc.optimizer = optimizer.second;
+      Report("steps " + shooting.first + ", " + optimizer.first,
+             RunClosedLoop(track, ticks,
+          [&mpc](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                 const Vehicle& car) {
+            mpc.SetFrame(car.x, car.y, car.psi);
+            return mpc.Solve(state, coeffs, Deadline());
+          }));
+    }
+  }
+
+  for (const auto& optimizer : optimizers) {
+    for (int budget_us : {100000, 1000, 200}) {
+      string budget = ", budget " + to_string(budget_us) + " us, ";
+      auto deadline = [budget_us]() {
+        return chrono::steady_clock::now() + chrono::microseconds(budget_us);
+      };
+
+      MPC mpc(MPC::ANALYTIC);
+      mpc.optimizer = optimizer.second;
+      Report("N = " + to_string(N) + budget + optimizer.first,
+             RunClosedLoop(track, ticks,
+          [&mpc, &deadline](const Eigen::VectorXd& state,
+                            const Eigen::VectorXd& coeffs, const Vehicle& car) {
+            mpc.SetFrame(car.x, car.y, car.psi);
+            return mpc.Solve(state, coeffs, deadline());
+          }));
+
+      MPC_adaptive adaptive(
+          MPC_adaptive::Horizons(MPC_config(), {8, 10, 12, 15, 20}));
+      adaptive.SetOptimizer(optimizer.second);
+      Report("adaptive N" + budget + optimizer.first,
+             RunClosedLoop(track, ticks,
+          [&adaptive, &deadline](const Eigen::VectorXd& state,
+                                 const Eigen::VectorXd& coeffs,
+                                 const Vehicle& car) {
+            adaptive.SetFrame(car.x, car.y, car.psi);
+            return adaptive.Solve(state, coeffs, deadline());
+          }));
+      cout << "  solves per preview:";
+      for (size_t i = 0; i < adaptive.Candidates(); i++) {
+        cout << " " << adaptive.Preview(i) << " s " << adaptive.solves[i];
+      }
+      cout << endl;
+    }
+  }
+
+  // Racing the optimizers against pure pursuit under the same budgets: the
+  // answer is there by the deadline, from the fallback where the solve
+  // failed or was late. The closed loop runs the ticks back to back, so a
+  // late solve keeps the optimizer busy over the next ticks, where at the
+  // period of the simulator it would be idle again.
+  Pure_pursuit pursuit;
+  Report("pure pursuit", RunClosedLoop(track, ticks,
+      [&pursuit](const Eigen::VectorXd& state, const Eigen::VectorXd& coeffs,
+                 const Vehicle& car) {
+        return pursuit.Solve(state, coeffs, Deadline());
+      }));
+  for (const auto& optimizer : optimizers) {
+    for (int budget_us : {100000, 1000, 200}) {
+      auto deadline = [budget_us]() {
+        return chrono::steady_clock::now() + chrono::microseconds(budget_us);
+      };
+
+      MPC* mpc = new MPC(MPC::ANALYTIC);
+      mpc->optimizer = optimizer.second;
+      MPC_race race(unique_ptr<Controller>(mpc),
+                    unique_ptr<Controller>(new Pure_pursuit()));
+      race.margin = chrono::microseconds(budget_us / 5);
+      Report("race, budget " + to_string(budget_us) + " us, " +
+                 optimizer.first,
+             RunClosedLoop(track, ticks,
+          [&race, &deadline](const Eigen::VectorXd& state,
+                             const Eigen::VectorXd& coeffs,
+                             const Vehicle& car) {
+            race.SetFrame(car.x, car.y, car.psi);
+            return race.Solve(state, coeffs, deadline());
+          }));
+      cout << "  fallbacks " << race.fallbacks << " of " << race.ticks
+           << ": failed " << race.failed << ", late " << race.late
+           << ", busy " << race.busy << endl;
+    }
+  }
+
+  // Multiple starts: the shifted plan against the best of it, zero, an arc
+  // and a pure pursuit rollout, at N = 10 and at N = 20, where a single
+  // solve fails more often. The wall time of a tick depends on the starts
+  // finding a core each. Ipopt is left out, its solves take turns.
+  for (size_t horizon : {10, 20}) {
+    for (const auto& optimizer : optimizers) {
+      if (optimizer.second == MPC::IPOPT) {
+        continue;
+      }
+      string n = "N = " + to_string(horizon) + ", ";
+      MPC_config config;
+      config.N = horizon;
+      MPC single(config, MPC::ANALYTIC);
+      single.optimizer = optimizer.second;
+      Report(n + "single start, " + optimizer.first,
+             RunClosedLoop(track, ticks,
+          [&single](const Eigen::VectorXd& state,
+                    const Eigen::VectorXd& coeffs, const Vehicle& car) {
+            single.SetFrame(car.x, car.y, car.psi);
+            return single.Solve(state, coeffs, Deadline());
+          }));
+
+      MPC_multistart multistart(config, MPC::ANALYTIC);
+      multistart.SetOptimizer(optimizer.second);
+      Report(n + "multistart, " + optimizer.first,
+             RunClosedLoop(track, ticks,
+          [&multistart](const Eigen::VectorXd& state,
+                        const Eigen::VectorXd& coeffs, const Vehicle& car) {
+            multistart.SetFrame(car.x, car.y, car.psi);
+            return multistart.Solve(state, coeffs, Deadline());
+          }));
+      const char* names[] = {"shifted", "zero", "arc", "pursuit"};
+      cout << "  wins:";
+      for (size_t i = 0; i < multistart.Starts(); i++) {
+        cout << " " << names[multistart.Start(i)] << " "
+             << multistart.wins[i];
+      }
+      cout << ", cancelled " << multistart.cancelled << endl;
+    }
+  }
+  return 0;
+}
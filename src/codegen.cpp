@@ -0,0 +1,459 @@
+// Build-time generator of the derivative kernels of FG_eval.
+//
+// FG_eval is evaluated once with a symbolic scalar that records the
+// expression graph of the cost and constraints, with the horizon N and the
+// step length dt of MPC_model.h fixed. The graph is differentiated
+// symbolically and written out as straight-line C++ for the cost, its
+// gradient, the constraints, the sparse constraint Jacobian and the lower
+// triangle of the sparse Hessian of the Lagrangian (see FG_generated.h).
+//
+// Usage: mpc_codegen output.cpp
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "FG_eval.h"
+
+using namespace std;
+
+//
+// Expression graph
+//
+
+struct Node {
+  enum Op {
+    CONST, VAR, PARAM, LAMBDA, OBJ_FACTOR,
+    ADD, SUB, MUL, DIV, NEG, SIN, COS, ATAN
+  };
+  Op op;
+  // operands, the nodes are stored in topological order so a < id, b < id
+  int a, b;
+  // value of a constant, index of a variable, parameter or multiplier
+  double value;
+  int index;
+};
+
+// All the nodes, equal nodes are only stored once.
+vector<Node> nodes;
+map<tuple<int, int, int, double, int>, int> lookup;
+
+int Insert(Node::Op op, int a, int b, double value, int index) {
+  auto key = make_tuple((int)op, a, b, value, index);
+  auto it = lookup.find(key);
+  if (it != lookup.end()) {
+    return it->second;
+  }
+  Node node = {op, a, b, value, index};
+  nodes.push_back(node);
+  lookup[key] = nodes.size() - 1;
+  return nodes.size() - 1;
+}
+
+int Constant(double value) { return Insert(Node::CONST, -1, -1, value, 0); }
+
+bool IsConstant(int id, double value) {
+  return nodes[id].op == Node::CONST && nodes[id].value == value;
+}
+
+bool IsConstant(int id) { return nodes[id].op == Node::CONST; }
+
+// Create a node, folding constants and dropping the trivial operations so
+// that structural zeros of the derivatives vanish.
+int Make(Node::Op op, int a, int b = -1) {
+  if (IsConstant(a) && (b < 0 || IsConstant(b))) {
+    double u = nodes[a].value;
+    double v = b < 0 ? 0.0 : nodes[b].value;
+    switch (op) {
+      case Node::ADD: return Constant(u + v);
+      case Node::SUB: return Constant(u - v);
+      case Node::MUL: return Constant(u * v);
+      case Node::DIV: return Constant(u / v);
+      case Node::NEG: return Constant(-u);
+      case Node::SIN: return Constant(sin(u));
+      case Node::COS: return Constant(cos(u));
+      case Node::ATAN: return Constant(atan(u));
+      default: break;
+    }
+  }
+  switch (op) {
+    case Node::ADD:
+      if (IsConstant(a, 0.0)) return b;
+      if (IsConstant(b, 0.0)) return a;
+      if (a > b) swap(a, b);
+      break;
+    case Node::SUB:
+      if (IsConstant(b, 0.0)) return a;
+      if (IsConstant(a, 0.0)) return Make(Node::NEG, b);
+      if (a == b) return Constant(0.0);
+      break;
+    case Node::MUL:
+      if (IsConstant(a, 0.0) || IsConstant(b, 0.0)) return Constant(0.0);
+      if (IsConstant(a, 1.0)) return b;
+      if (IsConstant(b, 1.0)) return a;
+      if (IsConstant(a, -1.0)) return Make(Node::NEG, b);
+      if (IsConstant(b, -1.0)) return Make(Node::NEG, a);
+      if (a > b) swap(a, b);
+      break;
+    case Node::DIV:
+      if (IsConstant(a, 0.0)) return Constant(0.0);
+      if (IsConstant(b, 1.0)) return a;
+      break;
+    case Node::NEG:
+      if (nodes[a].op == Node::NEG) return nodes[a].a;
+      break;
+    default:
+      break;
+  }
+  return Insert(op, a, b, 0.0, 0);
+}
+
+// Symbolic scalar for FG_eval, a handle to a node of the graph.
+class Sym {
+ public:
+  Sym() : id(Constant(0.0)) {}
+  Sym(double value) : id(Constant(value)) {}
+
+  static Sym Of(int id) {
+    Sym s;
+    s.id = id;
+    return s;
+  }
+
+  Sym& operator+=(const Sym& other) {
+    id = Make(Node::ADD, id, other.id);
+    return *this;
+  }
+
+  int id;
+};
+
+Sym operator+(const Sym& a, const Sym& b) {
+  return Sym::Of(Make(Node::ADD, a.id, b.id));
+}
+Sym operator-(const Sym& a, const Sym& b) {
+  return Sym::Of(Make(Node::SUB, a.id, b.id));
+}
+Sym operator*(const Sym& a, const Sym& b) {
+  return Sym::Of(Make(Node::MUL, a.id, b.id));
+}
+Sym operator/(const Sym& a, const Sym& b) {
+  return Sym::Of(Make(Node::DIV, a.id, b.id));
+}
+Sym operator-(const Sym& a) { return Sym::Of(Make(Node::NEG, a.id)); }
+Sym sin(const Sym& a) { return Sym::Of(Make(Node::SIN, a.id)); }
+Sym cos(const Sym& a) { return Sym::Of(Make(Node::COS, a.id)); }
+Sym atan(const Sym& a) { return Sym::Of(Make(Node::ATAN, a.id)); }
+
+// Integer powers are expanded into products.
+Sym pow(const Sym& a, int n) {
+  if (n < 0) {
+    return Sym(1.0) / pow(a, -n);
+  }
+  Sym result(1.0);
+  for (int i = 0; i < n; i++) {
+    result = result * a;
+  }
+  return result;
+}
+
+//
+// Symbolic differentiation
+//
+
+// Sparse gradient of a node with respect to the variables: variable index
+// to the node of the partial derivative. Zero partials are not stored.
+typedef map<int, int> Gradient;
+
+map<int, Gradient> gradients;
+
+// a + factor * b
+Gradient Axpy(const Gradient& a, int factor, const Gradient& b) {
+  Gradient result = a;
+  for (auto& entry : b) {
+    int term = Make(Node::MUL, factor, entry.second);
+    auto it = result.find(entry.first);
+    if (it == result.end()) {
+      result[entry.first] = term;
+    } else {
+      it->second = Make(Node::ADD, it->second, term);
+    }
+  }
+  // drop the partials that cancelled out
+  for (auto it = result.begin(); it != result.end();) {
+    if (IsConstant(it->second, 0.0)) {
+      it = result.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return result;
+}
+
+const Gradient& Differentiate(int id) {
+  auto it = gradients.find(id);
+  if (it != gradients.end()) {
+    return it->second;
+  }
+
+  // copy, the graph grows while the partials are created
+  Node node = nodes[id];
+  Gradient empty;
+  Gradient result;
+  int one = Constant(1.0);
+  int minus_one = Constant(-1.0);
+  switch (node.op) {
+    case Node::VAR:
+      result[node.index] = one;
+      break;
+    case Node::ADD:
+      result = Axpy(Differentiate(node.a), one, Differentiate(node.b));
+      break;
+    case Node::SUB:
+      result = Axpy(Differentiate(node.a), minus_one, Differentiate(node.b));
+      break;
+    case Node::MUL:
+      // d(a b) = b da + a db
+      result = Axpy(Axpy(empty, node.b, Differentiate(node.a)), node.a,
+                    Differentiate(node.b));
+      break;
+    case Node::DIV: {
+      // d(a / b) = (da - (a / b) db) / b
+      int inv = Make(Node::DIV, one, node.b);
+      int quotient = Make(Node::NEG, Make(Node::MUL, id, inv));
+      result = Axpy(Axpy(empty, inv, Differentiate(node.a)), quotient,
+                    Differentiate(node.b));
+      break;
+    }
+    case Node::NEG:
+      result = Axpy(empty, minus_one, Differentiate(node.a));
+      break;
+    case Node::SIN:
+      result = Axpy(empty, Make(Node::COS, node.a), Differentiate(node.a));
+      break;
+    case Node::COS:
+      result = Axpy(empty, Make(Node::NEG, Make(Node::SIN, node.a)),
+                    Differentiate(node.a));
+      break;
+    case Node::ATAN: {
+      // d atan(a) = da / (1 + a^2)
+      int square = Make(Node::MUL, node.a, node.a);
+      int factor = Make(Node::DIV, one, Make(Node::ADD, one, square));
+      result = Axpy(empty, factor, Differentiate(node.a));
+      break;
+    }
+    default:
+      // constants, parameters and multipliers
+      break;
+  }
+  return gradients[id] = result;
+}
+
+//
+// Code emission
+//
+
+string Literal(double value) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.17g", value);
+  string s(buffer);
+  if (s.find_first_of(".en") == string::npos) {
+    s += ".0";
+  }
+  return value < 0 ? "(" + s + ")" : s;
+}
+
+// Write the body of a kernel: every shared interior node of the outputs is
+// evaluated once into a local, then the outputs are assigned.
+void EmitBody(ostream& out, const vector<pair<string, int> >& outputs) {
+  vector<bool> needed(nodes.size(), false);
+  vector<int> stack;
+  for (auto& output : outputs) {
+    stack.push_back(output.second);
+  }
+  while (!stack.empty()) {
+    int id = stack.back();
+    stack.pop_back();
+    if (needed[id]) {
+      continue;
+    }
+    needed[id] = true;
+    if (nodes[id].a >= 0) stack.push_back(nodes[id].a);
+    if (nodes[id].b >= 0) stack.push_back(nodes[id].b);
+  }
+
+  map<int, string> names;
+  auto name = [&](int id) -> string {
+    const Node& node = nodes[id];
+    switch (node.op) {
+      case Node::CONST: return Literal(node.value);
+      case Node::VAR: return "x[" + to_string(node.index) + "]";
+      case Node::PARAM: return "p[" + to_string(node.index) + "]";
+      case Node::LAMBDA: return "lambda[" + to_string(node.index) + "]";
+      case Node::OBJ_FACTOR: return "obj_factor";
+      default: return names[id];
+    }
+  };
+
+  // the operands always precede a node, so increasing ids are in order
+  for (size_t id = 0; id < nodes.size(); id++) {
+    const Node& node = nodes[id];
+    if (!needed[id] || node.op < Node::ADD) {
+      continue;
+    }
+    string expr;
+    switch (node.op) {
+      case Node::ADD: expr = name(node.a) + " + " + name(node.b); break;
+      case Node::SUB: expr = name(node.a) + " - " + name(node.b); break;
+      case Node::MUL: expr = name(node.a) + " * " + name(node.b); break;
+      case Node::DIV: expr = name(node.a) + " / " + name(node.b); break;
+      case Node::NEG: expr = "-" + name(node.a); break;
+      case Node::SIN: expr = "sin(" + name(node.a) + ")"; break;
+      case Node::COS: expr = "cos(" + name(node.a) + ")"; break;
+      case Node::ATAN: expr = "atan(" + name(node.a) + ")"; break;
+      default: break;
+    }
+    string local = "v" + to_string(names.size());
+    names[id] = local;
+    out << "  const double " << local << " = " << expr << ";\n";
+  }
+  for (auto& output : outputs) {
+    out << "  " << output.first << " = " << name(output.second) << ";\n";
+  }
+}
+
+void EmitArray(ostream& out, const string& name, const vector<int>& values) {
+  out << "extern const int " << name << "[] = {";
+  for (size_t k = 0; k < values.size(); k++) {
+    out << (k % 16 == 0 ? "\n    " : " ") << values[k]
+        << (k + 1 < values.size() ? "," : "");
+  }
+  out << "};\n\n";
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    cerr << "Usage: mpc_codegen output.cpp" << endl;
+    return -1;
+  }
+
+  // trace FG_eval, the polynomial coefficients and the reference velocity
+  // stay parameters of the kernels. The kernels are for the variable-major
+  // layout.
+  typedef vector<Sym> Symvector;
+  MPC_layout layout(N);
+  size_t n_vars = layout.n_vars;
+  size_t n_constraints = layout.n_constraints;
+  Symvector vars(n_vars);
+  for (size_t i = 0; i < n_vars; i++) {
+    vars[i] = Sym::Of(Insert(Node::VAR, -1, -1, 0.0, i));
+  }
+  Symvector coeffs(4);
+  for (size_t i = 0; i < 4; i++) {
+    coeffs[i] = Sym::Of(Insert(Node::PARAM, -1, -1, 0.0, i));
+  }
+  Sym ref_v = Sym::Of(Insert(Node::PARAM, -1, -1, 0.0, 4));
+  FG_eval<Symvector> fg_eval(layout, vector<double>(N - 1, dt), coeffs,
+                             ref_v);
+  Symvector fg(1 + n_constraints);
+  fg_eval(fg, vars);
+
+  // the Lagrangian obj_factor * f + sum_i lambda[i] * g[i]
+  Sym lagrangian = Sym::Of(Insert(Node::OBJ_FACTOR, -1, -1, 0.0, 0)) * fg[0];
+  for (size_t i = 0; i < n_constraints; i++) {
+    lagrangian += Sym::Of(Insert(Node::LAMBDA, -1, -1, 0.0, i)) * fg[1 + i];
+  }
+
+  ofstream out(argv[1]);
+  if (!out) {
+    cerr << "Failed to write " << argv[1] << endl;
+    return -1;
+  }
+  out << "// Generated by mpc_codegen from FG_eval, do not edit.\n"
+      << "// N = " << N << ", dt = " << dt << "\n"
+      << "#include <math.h>\n"
+      << "#include \"FG_generated.h\"\n\n"
+      << "namespace fg_kernels {\n\n"
+      << "extern const size_t n_vars = " << n_vars << ";\n"
+      << "extern const size_t n_constraints = " << n_constraints << ";\n\n";
+
+  // constraint Jacobian, row by row
+  vector<int> rows, cols;
+  vector<pair<string, int> > outputs;
+  for (size_t i = 0; i < n_constraints; i++) {
+    for (auto& entry : Differentiate(fg[1 + i].id)) {
+      rows.push_back(i);
+      cols.push_back(entry.first);
+      outputs.push_back(make_pair(
+          "values[" + to_string(outputs.size()) + "]", entry.second));
+    }
+  }
+  out << "extern const size_t jac_nnz = " << rows.size() << ";\n";
+  EmitArray(out, "jac_rows", rows);
+  EmitArray(out, "jac_cols", cols);
+  vector<pair<string, int> > jac_outputs = outputs;
+
+  // lower triangle of the Hessian of the Lagrangian, row by row
+  rows.clear();
+  cols.clear();
+  outputs.clear();
+  Gradient grad_lagrangian = Differentiate(lagrangian.id);
+  for (auto& row : grad_lagrangian) {
+    Gradient second = Differentiate(row.second);
+    for (auto& entry : second) {
+      if (entry.first > row.first) {
+        break;
+      }
+      rows.push_back(row.first);
+      cols.push_back(entry.first);
+      outputs.push_back(make_pair(
+          "values[" + to_string(outputs.size()) + "]", entry.second));
+    }
+  }
+  out << "extern const size_t hes_nnz = " << rows.size() << ";\n";
+  EmitArray(out, "hes_rows", rows);
+  EmitArray(out, "hes_cols", cols);
+  vector<pair<string, int> > hes_outputs = outputs;
+
+  out << "double F(const double* x, const double* p) {\n";
+  outputs.clear();
+  outputs.push_back(make_pair("const double f", fg[0].id));
+  EmitBody(out, outputs);
+  out << "  return f;\n}\n\n";
+
+  out << "void GradF(const double* x, const double* p, double* grad_f) {\n";
+  outputs.clear();
+  const Gradient& grad_f = Differentiate(fg[0].id);
+  for (size_t j = 0; j < n_vars; j++) {
+    auto it = grad_f.find(j);
+    outputs.push_back(make_pair("grad_f[" + to_string(j) + "]",
+                                it == grad_f.end() ? Constant(0.0)
+                                                   : it->second));
+  }
+  EmitBody(out, outputs);
+  out << "}\n\n";
+
+  out << "void G(const double* x, const double* p, double* g) {\n";
+  outputs.clear();
+  for (size_t i = 0; i < n_constraints; i++) {
+    outputs.push_back(make_pair("g[" + to_string(i) + "]", fg[1 + i].id));
+  }
+  EmitBody(out, outputs);
+  out << "}\n\n";
+
+  out << "void JacG(const double* x, const double* p, double* values) {\n";
+  EmitBody(out, jac_outputs);
+  out << "}\n\n";
+
+  out << "void H(const double* x, const double* p, double obj_factor,\n"
+      << "       const double* lambda, double* values) {\n";
+  EmitBody(out, hes_outputs);
+  out << "}\n\n";
+
+  out << "}  // namespace fg_kernels\n";
+  return 0;
+}
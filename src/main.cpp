@@ -1,12 +1,21 @@
 #include <math.h>
 #include <uWS/uWS.h>
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
 #include "Eigen-3.3/Eigen/QR"
 #include "MPC.h"
+#include "MPC_race.h"
+#include "MPC_registry.h"
+#include "MPC_table.h"
+#include "Pure_pursuit.h"
+#include "helpers.h"
 #include "json.hpp"
 
 // for convenience
@@ -28,6 +37,9 @@ constexpr double pi() { return M_PI; }
 double deg2rad(double x) { return x * pi() / 180; }
 double rad2deg(double x) { return x * 180 / pi(); }
 
+//latency time is 100 ms = 0.1 s
+const double time_latency = 0.1;
+
 // Checks if the SocketIO event has JSON data.
 // If there is data the JSON object in string format will be returned,
 // else the empty string "" will be returned.
@@ -43,46 +55,141 @@ string hasData(string s) {
   return "";
 }
 
-// Evaluate a polynomial.
-double polyeval(Eigen::VectorXd coeffs, double x) {
-  double result = 0.0;
-  for (int i = 0; i < coeffs.size(); i++) {
-    result += coeffs[i] * pow(x, i);
-  }
-  return result;
-}
-
-// Fit a polynomial.
-// Adapted from
-// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
-Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals,
-                        int order) {
-  assert(xvals.size() == yvals.size());
-  assert(order >= 1 && order <= xvals.size() - 1);
-  Eigen::MatrixXd A(xvals.size(), order + 1);
-
-  for (int i = 0; i < xvals.size(); i++) {
-    A(i, 0) = 1.0;
-  }
+int main(int argc, char* argv[]) {
+  uWS::Hub h;
 
-  for (int j = 0; j < xvals.size(); j++) {
-    for (int i = 0; i < order; i++) {
-      A(j, i + 1) = A(j, i) * xvals(j);
+  // --backend <name> picks the solver by its name in MPC_registry, Ipopt by
+  // default; --backends lists them. --riccati, --admm, --ilqr, --mppi and
+  // --frenet are short for --backend riccati and so on.
+  string backend = "ipopt";
+  MPC_options options;
+  // The derivatives come from the kernels generated at build time, unless
+  // --cppad (the recorded tape) or --analytic (hand-derived) is given.
+  // --rti takes one real-time iteration step per tick instead of a full
+  // solve, --adaptive chooses the horizon of every tick among N = 8, 10, 12,
+  // 15 and 20.
+  // --multistart solves from several initial guesses at once and keeps the
+  // best plan, see MPC_multistart.
+  // --race solves against a pure pursuit fallback that answers whenever the
+  // backend does not converge by the deadline, see MPC_race
+  bool race = false;
+  // --table <file> answers from the explicit MPC table written by mpc_table
+  // where it covers the telemetry
+  MPC_table table;
+  bool explicit_mpc = false;
+  // --stage-major orders the variables and constraints stage by stage,
+  // --ldlt solves the Ipopt steps with the sparse LDLT of Eigen,
+  // --gauss-newton and --lbfgs replace the exact Hessian of the Lagrangian,
+  // --blocks 1,1,2,2,4 holds the actuation over blocks of steps,
+  // --steps 0.05,0.05,0.2 sets the length of every step of the horizon,
+  // --integrator rk2|rk4 and --substeps 4 integrate the model over each
+  // step with a higher order or in substeps
+  MPC_config& config = options.config;
+  for (int i = 1; i < argc; i++) {
+    if (string(argv[i]) == "--backend" && i + 1 < argc) {
+      backend = argv[++i];
+    } else if (string(argv[i]) == "--backends") {
+      for (const auto& entry : MPC_registry::Backends()) {
+        cout << entry.first << ": " << entry.second << endl;
+      }
+      return 0;
+    } else if (string(argv[i]) == "--rti") {
+      options.real_time_iteration = true;
+    } else if (string(argv[i]) == "--adaptive") {
+      options.adaptive = true;
+    } else if (string(argv[i]) == "--multistart") {
+      options.multistart = true;
+    } else if (string(argv[i]) == "--race") {
+      race = true;
+    } else if (string(argv[i]) == "--frenet") {
+      backend = "frenet";
+    } else if (string(argv[i]) == "--table" && i + 1 < argc) {
+      if (!table.Open(argv[++i])) {
+        cerr << "Failed to map the table " << argv[i] << endl;
+        return -1;
+      }
+      explicit_mpc = true;
+    } else if (string(argv[i]) == "--riccati") {
+      backend = "riccati";
+    } else if (string(argv[i]) == "--admm") {
+      backend = "admm";
+    } else if (string(argv[i]) == "--ilqr") {
+      backend = "ilqr";
+    } else if (string(argv[i]) == "--mppi") {
+      backend = "mppi";
+    } else if (string(argv[i]) == "--cppad") {
+      options.derivatives = MPC::CPPAD;
+    } else if (string(argv[i]) == "--analytic") {
+      options.derivatives = MPC::ANALYTIC;
+    } else if (string(argv[i]) == "--stage-major") {
+      config.layout = MPC_layout::STAGE_MAJOR;
+    } else if (string(argv[i]) == "--ldlt") {
+      config.linear_solver = MPC_config::EIGEN_LDLT;
+    } else if (string(argv[i]) == "--gauss-newton") {
+      config.hessian = MPC_config::GAUSS_NEWTON;
+    } else if (string(argv[i]) == "--lbfgs") {
+      config.hessian = MPC_config::LBFGS;
+    } else if (string(argv[i]) == "--blocks" && i + 1 < argc) {
+      stringstream lengths(argv[++i]);
+      string length;
+      while (getline(lengths, length, ',')) {
+        config.blocks.push_back(atoi(length.c_str()));
+      }
+    } else if (string(argv[i]) == "--steps" && i + 1 < argc) {
+      stringstream lengths(argv[++i]);
+      string length;
+      while (getline(lengths, length, ',')) {
+        config.steps.push_back(atof(length.c_str()));
+      }
+    } else if (string(argv[i]) == "--integrator" && i + 1 < argc) {
+      string method = argv[++i];
+      if (method == "rk2") {
+        config.integrator.method = MPC_integrator::RK2;
+      } else if (method == "rk4") {
+        config.integrator.method = MPC_integrator::RK4;
+      } else if (method != "euler") {
+        cerr << "--integrator is euler, rk2 or rk4" << endl;
+        return -1;
+      }
+    } else if (string(argv[i]) == "--substeps" && i + 1 < argc) {
+      config.integrator.substeps = max(atoi(argv[++i]), 1);
     }
   }
 
-  auto Q = A.householderQr();
-  auto result = Q.solve(yvals);
-  return result;
-}
+  // the rate penalties need at least two steps
+  if (!config.steps.empty() &&
+      (config.steps.size() < 2 ||
+       *min_element(config.steps.begin(), config.steps.end()) <= 0.0)) {
+    cerr << "--steps needs two or more positive step lengths" << endl;
+    return -1;
+  }
 
-int main() {
-  uWS::Hub h;
+  // the table stands in for the backend, so it has to be solved for the
+  // same problem: MPC_frenet and pure pursuit follow other ones
+  if (explicit_mpc && (backend == "frenet" || backend == "pursuit" ||
+                       !table.Solves(config, time_latency))) {
+    cerr << "--table was solved for another problem than --backend "
+         << backend << " with these options" << endl;
+    return -1;
+  }
 
   // MPC is initialized here!
-  MPC mpc;
+  string error;
+  unique_ptr<Controller> mpc = MPC_registry::Make(backend, options, error);
+  if (!mpc) {
+    cerr << "--backend " << backend << ": " << error << endl;
+    return -1;
+  }
+  MPC_race* racer = nullptr;
+  if (race) {
+    racer = new MPC_race(move(mpc),
+                         unique_ptr<Controller>(new Pure_pursuit(config)));
+    mpc.reset(racer);
+  }
+  // last actuation sent to the simulator, held when the solver fails
+  double last_steer_value = 0.0;
 
-  h.onMessage([&mpc](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
+  h.onMessage([&mpc, &last_steer_value, &table, explicit_mpc](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
                      uWS::OpCode opCode) {
     // "42" at the start of the message means there's a websocket message event.
     // The 4 signifies a websocket message
@@ -95,6 +202,9 @@ int main() {
         auto j = json::parse(s);
         string event = j[0].get<string>();
         if (event == "telemetry") {
+          // the solver has to finish within one control period, 100 ms
+          auto deadline = chrono::steady_clock::now() + chrono::milliseconds(100);
+
           // j[1] is the data JSON object
           //The global x positions of the way points.
           vector<double> ptsx = j[1]["ptsx"];
@@ -166,8 +276,6 @@ int main() {
 
           // This is the length from front to CoG that has a similar radius.
           const double Lf = 2.67;
-          //latency time is 100 ms = 0.1 s
-          const double time_latency = 0.1;
           //projected states
           //Note if delta is positive we rotate counter-clockwise, or turn left.
           // In the simulator however, a positive value implies a right turn and
@@ -183,12 +291,28 @@ int main() {
           //store the state values to vector state
           state << proj_x, proj_y, proj_psi, proj_v, proj_cte, proj_epsi;
 
-          //Calculate the control signals via MPC
-          auto vars = mpc.Solve(state, coeffs);
+          //Answer from the explicit MPC table where it covers the telemetry
+          MPC_result result;
+          double key[MPC_table::n_axes];
+          MPC_table::Key(v, delta, a, coeffs, time_latency, key);
+          bool solved = !(explicit_mpc && table.Lookup(key, result));
+          if (solved) {
+              //Calculate the control signals with the backend, the pose of the vehicle frame
+              //lets it warm start from the previous solution
+              mpc->SetFrame(px, py, psi);
+              result = mpc->Solve(state, coeffs, deadline);
+          }
 
           //Get steer and throttle values
-          double steer_value = vars[0];
-          double throttle_value = vars[1];
+          double steer_value = result.delta;
+          double throttle_value = result.a;
+          //A solve cut at the deadline still returns its best feasible plan. Without any
+          //usable plan, hold the steering angle and coast.
+          if (result.status == MPC_result::FAILED) {
+              steer_value = last_steer_value;
+              throttle_value = 0.0;
+          }
+          last_steer_value = steer_value;
 
           json msgJson;
           // NOTE: Remember to divide by deg2rad(25) before you send the steering value back.
@@ -204,10 +328,8 @@ int main() {
 
           //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
           // the points in the simulator are connected by a Green line
-          for (unsigned int i = 2; i < vars.size(); i += 2) {
-              mpc_x_vals.push_back(vars[i]);
-              mpc_y_vals.push_back(vars[i+1]);
-          }
+          mpc_x_vals = result.x;
+          mpc_y_vals = result.y;
 
           msgJson["mpc_x"] = mpc_x_vals;
           msgJson["mpc_y"] = mpc_y_vals;
@@ -239,6 +361,13 @@ int main() {
           // SUBMITTING.
           this_thread::sleep_for(chrono::milliseconds(100));
           ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+
+          //The next step is prepared while waiting for the next telemetry,
+          //e.g. linearized for the real-time iteration, only on the solution
+          //and frame of this tick
+          if (solved) {
+              mpc->Prepare(coeffs);
+          }
         }
       } else {
         // Manual driving
@@ -266,10 +395,15 @@ int main() {
     std::cout << "Connected!!!" << std::endl;
   });
 
-  h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code,
-                         char *message, size_t length) {
+  h.onDisconnection([&h, racer](uWS::WebSocket<uWS::SERVER> ws, int code,
+                                char *message, size_t length) {
     ws.close();
     std::cout << "Disconnected" << std::endl;
+    if (racer) {
+      std::cout << "fallbacks " << racer->fallbacks << " of " << racer->ticks
+                << " ticks: " << racer->failed << " failed, " << racer->late
+                << " late, " << racer->busy << " busy" << std::endl;
+    }
   });
 
   int port = 4567;
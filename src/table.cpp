@@ -0,0 +1,174 @@
+// Offline solver of the explicit MPC table, see MPC_table.
+//
+// Usage: mpc_table <output> [--plans] [--threads n] [--check n]
+//
+// Every point of the grid is solved from a cold start with the Riccati SQP,
+// which unlike Ipopt can run in several threads at once. --plans stores the
+// whole plan of the solve instead of the first actuations only. --check
+// compares the interpolation at random keys to online solves.
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "MPC_table.h"
+
+using namespace std;
+
+// control period and actuation latency of the simulator, 100 ms
+const double latency = 0.1;
+
+// Covered region: speed, applied steering angle, cte, epsi, k2 and k3.
+MPC_table::Grid DefaultGrid() {
+  MPC_table::Grid grid = {
+      {9, 5, 9, 9, 5, 3},
+      {0.0, -0.44, -1.0, -0.2, -0.02, -0.0004},
+      {80.0, 0.44, 1.0, 0.2, 0.02, 0.0004}};
+  return grid;
+}
+
+// Key of grid point `index`, the first axis varies slowest.
+void GridKey(const MPC_table::Grid& grid, size_t index, double* key) {
+  for (int d = MPC_table::n_axes - 1; d >= 0; d--) {
+    size_t i = index % grid.points[d];
+    index /= grid.points[d];
+    key[d] = grid.lower[d] +
+             (grid.upper[d] - grid.lower[d]) * i / (grid.points[d] - 1);
+  }
+}
+
+MPC_result SolveKey(MPC& mpc, const double* key) {
+  Eigen::VectorXd state, coeffs;
+  MPC_table::Input(key, latency, state, coeffs);
+  return mpc.Solve(state, coeffs,
+                   chrono::steady_clock::now() + chrono::seconds(10));
+}
+
+MPC* NewSolver() {
+  MPC* mpc = new MPC();
+  mpc->optimizer = MPC::RICCATI;
+  mpc->warm_start = false;
+  return mpc;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    cerr << "Usage: mpc_table <output> [--plans] [--threads n] [--check n]"
+         << endl;
+    return -1;
+  }
+  string path = argv[1];
+  bool plans = false;
+  int threads = max(1u, thread::hardware_concurrency());
+  int checks = 0;
+  for (int i = 2; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--plans") {
+      plans = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = max(1, atoi(argv[++i]));
+    } else if (arg == "--check" && i + 1 < argc) {
+      checks = atoi(argv[++i]);
+    }
+  }
+
+  MPC_table::Grid grid = DefaultGrid();
+  size_t n_points = 1;
+  for (int d = 0; d < MPC_table::n_axes; d++) {
+    n_points *= grid.points[d];
+  }
+  const uint32_t n_values = plans ? 2 + 2 * N : 2;
+  vector<float> values(n_points * n_values);
+
+  // the workers take the next point until the grid is done
+  auto t0 = chrono::steady_clock::now();
+  atomic<size_t> next(0);
+  atomic<size_t> failed(0);
+  vector<thread> workers;
+  for (int i = 0; i < threads; i++) {
+    workers.push_back(thread([&]() {
+      unique_ptr<MPC> mpc(NewSolver());
+      double key[MPC_table::n_axes];
+      for (size_t p = next++; p < n_points; p = next++) {
+        GridKey(grid, p, key);
+        MPC_result result = SolveKey(*mpc, key);
+        float* point = &values[p * n_values];
+        if (result.status != MPC_result::CONVERGED) {
+          failed++;
+          for (uint32_t k = 0; k < n_values; k++) {
+            point[k] = NAN;
+          }
+          continue;
+        }
+        point[0] = result.delta;
+        point[1] = result.a;
+        for (uint32_t k = 2; k < n_values; k += 2) {
+          point[k] = result.x[(k - 2) / 2];
+          point[k + 1] = result.y[(k - 2) / 2];
+        }
+      }
+    }));
+  }
+  for (thread& worker : workers) {
+    worker.join();
+  }
+  auto t1 = chrono::steady_clock::now();
+  cout << n_points << " points in "
+       << chrono::duration<double>(t1 - t0).count() << " s on " << threads
+       << " threads, " << failed << " failed, "
+       << n_points * n_values * sizeof(float) / 1024 << " KiB" << endl;
+  MPC_table::Problem problem = MPC_table::ProblemOf(MPC_config(), latency);
+  if (!MPC_table::Write(path, grid, problem, n_values, values)) {
+    cerr << "Failed to write " << path << endl;
+    return -1;
+  }
+
+  if (checks > 0) {
+    MPC_table table;
+    if (!table.Open(path)) {
+      cerr << "Failed to map " << path << endl;
+      return -1;
+    }
+    unique_ptr<MPC> mpc(NewSolver());
+    mt19937 gen(1);
+    double key[MPC_table::n_axes];
+    MPC_result answer;
+    int hits = 0;
+    double delta_sum = 0.0, delta_error_max = 0.0;
+    double a_sum = 0.0, a_error_max = 0.0;
+    double lookup_us = 0.0;
+    for (int c = 0; c < checks; c++) {
+      for (int d = 0; d < MPC_table::n_axes; d++) {
+        uniform_real_distribution<double> uniform(grid.lower[d],
+                                                  grid.upper[d]);
+        key[d] = uniform(gen);
+      }
+      auto t2 = chrono::steady_clock::now();
+      bool hit = table.Lookup(key, answer);
+      auto t3 = chrono::steady_clock::now();
+      lookup_us += chrono::duration<double, micro>(t3 - t2).count();
+      MPC_result result = SolveKey(*mpc, key);
+      if (!hit || result.status != MPC_result::CONVERGED) {
+        continue;
+      }
+      hits++;
+      double delta_error = fabs(answer.delta - result.delta);
+      double a_error = fabs(answer.a - result.a);
+      delta_sum += delta_error;
+      delta_error_max = max(delta_error_max, delta_error);
+      a_sum += a_error;
+      a_error_max = max(a_error_max, a_error);
+    }
+    cout << "check at " << checks << " random keys: " << hits
+         << " answered by the table, mean lookup " << lookup_us / checks
+         << " us, delta error mean " << delta_sum / max(hits, 1) << " max "
+         << delta_error_max << ", a error mean " << a_sum / max(hits, 1)
+         << " max " << a_error_max << endl;
+  }
+  return 0;
+}